@@ -2,20 +2,24 @@
 #include "contiki-lib.h"
 #include "contiki-net.h"
 #include "dev/serial-line.h"
-#include "dev/slip.h"
 #include "lib/random.h"
-#include "lib/trickle-timer.h"
 #include "net/ip/uip.h"
 #include "net/ip/uip-debug.h"
 #include "net/ipv6/uip-ds6.h"
 #include "net/netstack.h"
 #include "net/rpl/rpl.h"
 #include "net/rpl/rpl-private.h"
+#include "cfs/cfs.h"
 #include "simple-udp.h"
 #include "servreg-hack.h"
 #include "sys/ctimer.h"
 #include "sys/etimer.h"
 
+#include "config-dissem.h"
+#include "node-stats.h"
+#include "slip-bridge.h"
+#include "sample-batch.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,83 +37,130 @@
 
 #define UDP_PORT 1234
 #define SERVICE_ID 190
-#define IMIN 16 /* ticks */
-#define IMAX 10 /* doublings */
-#define REDUNDANCY_CONST 2
-#define NSAMPLES 3
-#define TRICKLE_PROTO_PORT 30001
 
-struct sample
-{
-  int value;
-  int index;
-  int interval;
-};
+/*
+ * The last config version we originated survives reboots in this file,
+ * with our last sampling period command so that it can be issued again:
+ *   version (u16), selector type (u8), lo (u16), hi (u16), interval (u16)
+ */
+#define VERSION_FILE "cfgver"
+#define VERSION_RECORD_LEN 9
 
-struct trickle_packet
-{
-  uint8_t token;
-  int node;
-  int interval;
-};
+/* Without a saved version we listen this long before originating, so
+ * that the table takes up the version the network is at rather than
+ * starting over at CONFIG_VERSION_INIT */
+#define VERSION_LISTEN 10 /* s */
 
 static struct simple_udp_connection unicast_connection;
 static struct uip_udp_conn *server_conn;
-static struct uip_udp_conn *trickle_conn;
 
 static struct etimer et;
-static struct trickle_timer tt;
-static int node = 0, interval = 0;
-static uip_ipaddr_t prefix, ipaddr;
+static struct config_selector sel; /* Our last sampling period command */
+static uint16_t interval = 0;
+static struct config_trickle trickle; /* Our last Trickle command */
+static uip_ipaddr_t prefix;
 static uint8_t prefix_set;
-static struct trickle_packet packet;
+static uint8_t version_known; /* Restored, or heard from the network */
 
 /*---------------------------------------------------------------------------*/
-PROCESS(unicast_receiver_process, "Unicast Receiver Process");
-PROCESS(border_router_process, "Border Router Process");
-PROCESS(webserver_nogui_process, "Web server");
-/*---------------------------------------------------------------------------*/
-static void tcpip_handler(void) {
-  if (uip_newdata()) {
-    struct trickle_packet data = ((struct trickle_packet *)uip_appdata)[0];
-    PRINTF("At %lu (I=%lu, c=%u): ", (unsigned long)clock_time(), (unsigned long)tt.i_cur, tt.c);
-    PRINTF("Our token=0x%02x, theirs=0x%02x\n", packet.token, data.token);
-
-    if (packet.token == data.token) {
-      PRINTF("Consistent RX\n");
-      trickle_timer_consistency(&tt);
-    }
-    else {
-      if ((signed char)(packet.token - data.token) < 0)
-      {
-        PRINTF("Theirs is newer. Update\n");
-        packet.token = data.token;
-      }
-      else PRINTF("They are behind\n");
-      trickle_timer_inconsistency(&tt);
+static void
+command_restore(void)
+{
+  uint8_t b[VERSION_RECORD_LEN];
+  int fd, n;
 
-      PRINTF("At %lu: Trickle inconsistency. Scheduled TX for %lu\n", (unsigned long)clock_time(), (unsigned long)(tt.ct.etimer.timer.start + tt.ct.etimer.timer.interval));
-    }
+  fd = cfs_open(VERSION_FILE, CFS_READ);
+  if (fd < 0) return;
+  n = cfs_read(fd, b, sizeof(b));
+  if (n >= 2)
+  {
+    config_table_seed((b[0] << 8) | b[1]);
+    version_known = 1;
+    printf("Restored config version 0x%04x\n", config_table_version());
   }
-  return;
+  /* Files from before the command was saved hold only the version */
+  if (n == sizeof(b))
+  {
+    sel.type = b[2];
+    sel.lo = (b[3] << 8) | b[4];
+    sel.hi = (b[5] << 8) | b[6];
+    interval = (b[7] << 8) | b[8];
+    printf("Restored command: selector %u [%u, %u] => interval %u\n", sel.type, sel.lo, sel.hi, interval);
+  }
+  cfs_close(fd);
 }
 /*---------------------------------------------------------------------------*/
-static void trickle_tx(void *ptr, uint8_t suppress) {
-
-  struct trickle_timer *loc_tt = (struct trickle_timer *)ptr;
-  if (suppress == TRICKLE_TIMER_TX_SUPPRESS) return;
+static void
+command_save(void)
+{
+  uint8_t b[VERSION_RECORD_LEN];
+  uint16_t v = config_table_version();
+  int fd;
 
-  PRINTF("At %lu (I=%lu, c=%u): ", (unsigned long)clock_time(), (unsigned long)loc_tt->i_cur, loc_tt->c);
-  PRINTF("Trickle TX token 0x%02x\n", packet.token);
+  b[0] = v >> 8;
+  b[1] = v & 0xff;
+  b[2] = sel.type;
+  b[3] = sel.lo >> 8;
+  b[4] = sel.lo & 0xff;
+  b[5] = sel.hi >> 8;
+  b[6] = sel.hi & 0xff;
+  b[7] = interval >> 8;
+  b[8] = interval & 0xff;
+  fd = cfs_open(VERSION_FILE, CFS_WRITE);
+  if (fd < 0 || cfs_write(fd, b, sizeof(b)) != sizeof(b)) printf("Could not save config version\n");
+  if (fd >= 0) cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static int
+version_ready(void)
+{
+  return version_known || clock_seconds() >= VERSION_LISTEN;
+}
+/*---------------------------------------------------------------------------*/
+static int
+command_apply(void)
+{
+  struct config_entry *e = config_table_lookup(&sel);
+  uint8_t i;
 
-  /* Destination IP: link-local all-nodes multicast */
-  uip_ipaddr_copy(&trickle_conn->ripaddr, &ipaddr);
-  uip_udp_packet_send(trickle_conn, &packet, sizeof(packet));
+  /* Nothing to disseminate if we hold the same entry and no newer one can
+   * override it */
+  if (e != NULL && e->interval == interval)
+  {
+    for (i = 0; i < config_table_count() && !config_version_newer(config_table_get(i)->version, e->version); i++);
+    if (i == config_table_count()) return 0;
+  }
 
-  /* Restore to 'accept incoming from any IP' */
-  uip_create_unspecified(&trickle_conn->ripaddr);
+  config_table_set(&sel, interval);
+  command_save();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Every node is pending until it acks the new version */
+static void
+disseminate(void)
+{
+  printf("At %lu: Disseminating config version 0x%04x\n", (unsigned long)clock_time(), config_table_version());
+  node_stats_version(config_table_version());
+  config_dissem_changed();
+}
+/*---------------------------------------------------------------------------*/
+static void
+config_adopted(const struct config_entry *e)
+{
+  version_known = 1;
+  /* The network still held a newer version of our last command from
+   * before a reboot: we now know its version, so issue ours again past it */
+  if (interval > 0 && config_selector_equal(&e->sel, &sel) && e->interval != interval && command_apply())
+  {
+    disseminate();
+  }
 }
 /*---------------------------------------------------------------------------*/
+PROCESS(unicast_receiver_process, "Unicast Receiver Process");
+PROCESS(border_router_process, "Border Router Process");
+PROCESS(webserver_nogui_process, "Web server");
+/*---------------------------------------------------------------------------*/
 
 #if WEBSERVER == 0
 /* No webserver */
@@ -120,25 +171,18 @@ AUTOSTART_PROCESSES(&border_router_process, &unicast_receiver_process);
 AUTOSTART_PROCESSES(&border_router_process, &webserver_nogui_process, &unicast_receiver_process);
 #else
 /* Use simple webserver with only one page for minimum footprint.
- * Multiple connections can result in interleaved tcp segments since
- * a single static buffer is used for all segments.
+ * Every segment is generated from per-connection state, so multiple
+ * connections and retransmissions are safe.
  */
 #include "httpd-simple.h"
+#include "sample-store.h"
 /* The internal webserver can provide additional information if
  * enough program flash is available.
  */
 #define WEBSERVER_CONF_LOADTIME 0
 #define WEBSERVER_CONF_FILESTATS 0
 #define WEBSERVER_CONF_NEIGHBOR_STATUS 0
-/* Adding links requires a larger RAM buffer. To avoid static allocation
- * the stack can be used for formatting; however tcp retransmissions
- * and multiple connections can result in garbled segments.
- * TODO:use PSOCk_GENERATOR_SEND and tcp state storage to fix this.
- */
 #define WEBSERVER_CONF_ROUTE_LINKS 0
-#if WEBSERVER_CONF_ROUTE_LINKS
-#define BUF_USES_STACK 1
-#endif
 
 
 PROCESS_THREAD(webserver_nogui_process, ev, data)
@@ -146,6 +190,7 @@ PROCESS_THREAD(webserver_nogui_process, ev, data)
   PROCESS_BEGIN();
 
   httpd_init();
+  sample_store_init();
 
   while (1)
   {
@@ -159,25 +204,35 @@ AUTOSTART_PROCESSES(&border_router_process, &webserver_nogui_process, &unicast_r
 
 static const char *TOP = "<html><head><title>ContikiRPL</title></head><body>\n";
 static const char *BOTTOM = "</body></html>\n";
-#if BUF_USES_STACK
-static char *bufptr, *bufend;
-#define ADD(...)                                              \
-  do                                                          \
-  {                                                           \
-    bufptr += snprintf(bufptr, bufend - bufptr, __VA_ARGS__); \
-  } while (0)
-#else
-static char buf[256];
-static int blen;
-#define ADD(...)                                                   \
-  do                                                               \
-  {                                                                \
-    blen += snprintf(&buf[blen], sizeof(buf) - blen, __VA_ARGS__); \
+/*---------------------------------------------------------------------------*/
+/* Generators write one TCP segment of output into uip_appdata */
+static char *out, *out_end;
+#define OUT(...)                                      \
+  do                                                  \
+  {                                                   \
+    out += snprintf(out, out_end - out, __VA_ARGS__); \
+    if (out > out_end) out = out_end;                 \
   } while (0)
-#endif
 /*---------------------------------------------------------------------------*/
 static void
-ipaddr_add(const uip_ipaddr_t *addr)
+out_begin(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  out = HTTPD_OUT(s);
+  out_end = out + HTTPD_OUT_LEN(s);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+out_len(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  return out - HTTPD_OUT(s);
+}
+/*---------------------------------------------------------------------------*/
+static void
+out_ipaddr(const uip_ipaddr_t *addr)
 {
   uint16_t a;
   int i, f;
@@ -187,7 +242,7 @@ ipaddr_add(const uip_ipaddr_t *addr)
     if (a == 0 && f >= 0)
     {
       if (f++ == 0)
-        ADD("::");
+        OUT("::");
     }
     else
     {
@@ -197,277 +252,1153 @@ ipaddr_add(const uip_ipaddr_t *addr)
       }
       else if (i > 0)
       {
-        ADD(":");
+        OUT(":");
       }
-      ADD("%x", a);
+      OUT("%x", a);
     }
   }
 }
 /*---------------------------------------------------------------------------*/
-static PT_THREAD(generate_routes(struct httpd_state *s))
+/* A whole number no larger than max */
+static int
+parse_number(const char *str, int base, long max, long *v)
 {
-  static uip_ds6_route_t *r;
-#if RPL_WITH_NON_STORING
-  static rpl_ns_node_t *link;
-#endif /* RPL_WITH_NON_STORING */
-  static uip_ds6_nbr_t *nbr;
-#if BUF_USES_STACK
-  char buf[256];
-#endif
-#if WEBSERVER_CONF_LOADTIME
-  static clock_time_t numticks;
-  numticks = clock_time();
-#endif
-  PSOCK_BEGIN(&s->sout);
+  char *end;
 
-  if (strcmp(s->filename[0], '/') == 0 && strcmp(s->filename[1], 's') == 0 && isdigit(s->filename[2]) && strcmp(s->filename[3], 'n') == 0 && isdigit(s->filename[4]))
-  {
-    interval = s->filename[2] - '0';
-    node = s->filename[4] - '0';
-    printf("Interval = '%d' - Node = '%d'\n", interval, node);
-  }
+  if (!(base == 16 ? isxdigit((unsigned char)*str) : isdigit((unsigned char)*str))) return 0;
+  *v = strtol(str, &end, base);
+  return *end == '\0' && *v <= max;
+}
+/*---------------------------------------------------------------------------*/
+/* <lo>-<hi>, hi in the given base */
+static int
+parse_range(char *str, int base, long *lo, long *hi)
+{
+  char *dash = strchr(str, '-');
 
-  SEND_STRING(&s->sout, TOP);
-#if BUF_USES_STACK
-  bufptr = buf;
-  bufend = bufptr + sizeof(buf);
-#else
-  blen = 0;
-#endif
-  char buffer[100];
-  snprintf(buffer, 100, "<h5>Change Node [%d] to Interval => NSAMPLEPERIOD%d</h5>", node, interval);
-  if (node >= 0 && (interval == 1 || interval == 2))
-    ADD(buffer);
-  ADD("Neighbors<pre>");
+  if (dash == NULL) return 0;
+  *dash = '\0';
+  return parse_number(str, 10, 0xffff, lo) && parse_number(dash + 1, base, 0xffff, hi);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * /set?p=<seconds>&<selector> sets the sampling period of the selected
+ * nodes, the selector being one of:
+ *   n=<id>          one node, 0 for all of them
+ *   i=<lo>-<hi>     node ids lo..hi
+ *   b=<base>-<hex>  node base + i for every bit i set in the hex mask
+ *   r=<lo>-<hi>     nodes whose RPL DAG rank is lo..hi
+ */
+static int
+parse_set(char *query)
+{
+  char *name, *value;
+  long p = 0, lo = 0, hi = 0;
+  int type = -1;
 
-  for (nbr = nbr_table_head(ds6_neighbors);
-       nbr != NULL;
-       nbr = nbr_table_next(ds6_neighbors, nbr))
+  while (httpd_query_next(&query, &name, &value))
   {
-
-#if WEBSERVER_CONF_NEIGHBOR_STATUS
-#if BUF_USES_STACK
+    if (strcmp(name, "p") == 0)
     {
-      char *j = bufptr + 25;
-      ipaddr_add(&nbr->ipaddr);
-      while (bufptr < j)
-        ADD(" ");
-      switch (nbr->state)
-      {
-      case NBR_INCOMPLETE:
-        ADD(" INCOMPLETE");
-        break;
-      case NBR_REACHABLE:
-        ADD(" REACHABLE");
-        break;
-      case NBR_STALE:
-        ADD(" STALE");
-        break;
-      case NBR_DELAY:
-        ADD(" DELAY");
-        break;
-      case NBR_PROBE:
-        ADD(" NBR_PROBE");
-        break;
-      }
+      if (!parse_number(value, 10, 0xffff, &p)) return 0;
+      continue;
     }
-#else
+    switch (name[0] != '\0' && name[1] == '\0' ? name[0] : 0)
     {
-      uint8_t j = blen + 25;
-      ipaddr_add(&nbr->ipaddr);
-      while (blen < j)
-        ADD(" ");
-      switch (nbr->state)
-      {
-      case NBR_INCOMPLETE:
-        ADD(" INCOMPLETE");
-        break;
-      case NBR_REACHABLE:
-        ADD(" REACHABLE");
-        break;
-      case NBR_STALE:
-        ADD(" STALE");
-        break;
-      case NBR_DELAY:
-        ADD(" DELAY");
-        break;
-      case NBR_PROBE:
-        ADD(" NBR_PROBE");
-        break;
-      }
+    case 'n':
+      type = CONFIG_SEL_NODE;
+      hi = 0;
+      if (!parse_number(value, 10, 0xffff, &lo)) return 0;
+      break;
+    case 'i':
+      type = CONFIG_SEL_RANGE;
+      if (!parse_range(value, 10, &lo, &hi) || hi < lo) return 0;
+      break;
+    case 'b':
+      type = CONFIG_SEL_BITMAP;
+      if (!parse_range(value, 16, &lo, &hi)) return 0;
+      break;
+    case 'r':
+      type = CONFIG_SEL_RANK;
+      if (!parse_range(value, 10, &lo, &hi) || hi < lo) return 0;
+      break;
+    default:
+      return 0;
     }
-#endif
-#else
-    ipaddr_add(&nbr->ipaddr);
-#endif
+  }
+  if (p <= 0 || type < 0) return 0;
 
-    ADD("\n");
-#if BUF_USES_STACK
-    if (bufptr > bufend - 45)
-    {
-      SEND_STRING(&s->sout, buf);
-      bufptr = buf;
-      bufend = bufptr + sizeof(buf);
-    }
-#else
-    if (blen > sizeof(buf) - 45)
+  interval = p;
+  sel.type = type;
+  sel.lo = lo;
+  sel.hi = hi;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * /trickle?imin=<ms>&imax=<doublings>&k=<redundancy> retunes the Trickle
+ * timers of the whole network. Parameters left out keep their value.
+ */
+static int
+parse_trickle(char *query)
+{
+  char *name, *value;
+  long v;
+
+  trickle = *config_dissem_trickle();
+  while (httpd_query_next(&query, &name, &value))
+  {
+    if (strcmp(name, "imin") == 0 && parse_number(value, 10, 0xffff, &v)) trickle.imin = v;
+    else if (strcmp(name, "imax") == 0 && parse_number(value, 10, 0xff, &v)) trickle.imax = v;
+    else if (strcmp(name, "k") == 0 && parse_number(value, 10, 0xff, &v)) trickle.k = v;
+    else return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The page is sent a piece at a time, one TCP segment each; s->index
+ * numbers the pieces of the entry at the cursor. Tables and counters can
+ * change before TCP has a segment acked, so the script copies what a
+ * piece shows into s->scratch before sending it and the generator prints
+ * only that copy, as feed_line does. A retransmission then repeats the
+ * segment byte for byte.
+ */
+union piece
+{
+  uint32_t v[5];
+  struct
+  {
+    uip_ipaddr_t addr;
+    uint32_t v;
+  } at;
+};
+
+#define PIECE(s) ((union piece *)(s)->scratch)
+
+/* Fails to compile if WEBSERVER_CONF_SCRATCH is too small */
+typedef char piece_fits[sizeof(union piece) <= HTTPD_SCRATCH ? 1 : -1];
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_take(struct httpd_state *s)
+{
+  uip_ds6_nbr_t *nbr = s->cursor;
+
+  uip_ipaddr_copy(&PIECE(s)->at.addr, &nbr->ipaddr);
+  PIECE(s)->at.v = nbr->state;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+page_neighbor(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  out_begin(arg);
+  out_ipaddr(&PIECE(s)->at.addr);
+#if WEBSERVER_CONF_NEIGHBOR_STATUS
+  {
+    char *j = HTTPD_OUT(s) + 25;
+    while (out < j)
+      OUT(" ");
+    switch (PIECE(s)->at.v)
     {
-      SEND_STRING(&s->sout, buf);
-      blen = 0;
+    case NBR_INCOMPLETE:
+      OUT(" INCOMPLETE");
+      break;
+    case NBR_REACHABLE:
+      OUT(" REACHABLE");
+      break;
+    case NBR_STALE:
+      OUT(" STALE");
+      break;
+    case NBR_DELAY:
+      OUT(" DELAY");
+      break;
+    case NBR_PROBE:
+      OUT(" NBR_PROBE");
+      break;
     }
+  }
 #endif
+  OUT("\n");
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+/* Pieces 1 and 2 hold an address and its trailer, piece 0 opens a link */
+static void
+page_link_piece(void *arg, uint8_t piece, const uip_ipaddr_t *addr)
+{
+  out_begin(arg);
+  if (piece == 0)
+  {
+    OUT("<a href=http://[");
+    out_ipaddr(addr);
+    OUT("]/status.shtml>");
+    return;
   }
-  ADD("</pre>Routes<pre>\n");
-  SEND_STRING(&s->sout, buf);
-#if BUF_USES_STACK
-  bufptr = buf;
-  bufend = bufptr + sizeof(buf);
-#else
-  blen = 0;
+  out_ipaddr(addr);
+#if WEBSERVER_CONF_ROUTE_LINKS
+  if (piece == 1) OUT("</a>");
 #endif
+}
+/*---------------------------------------------------------------------------*/
+/* Pieces 0 and 1 show the destination and its length, piece 2 the next
+ * hop and the lifetime */
+static void
+route_take(struct httpd_state *s, uint8_t piece)
+{
+  uip_ds6_route_t *r = s->cursor;
 
-  for (r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r))
+  if (piece < 2)
+  {
+    uip_ipaddr_copy(&PIECE(s)->at.addr, &r->ipaddr);
+    PIECE(s)->at.v = r->length;
+  }
+  else
   {
+    uip_ipaddr_copy(&PIECE(s)->at.addr, uip_ds6_route_nexthop(r));
+    PIECE(s)->at.v = r->state.lifetime;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+page_route(void *arg)
+{
+  struct httpd_state *s = arg;
 
-#if BUF_USES_STACK
-#if WEBSERVER_CONF_ROUTE_LINKS
-    ADD("<a href=http://[");
-    ipaddr_add(&r->ipaddr);
-    ADD("]/status.shtml>");
-    ipaddr_add(&r->ipaddr);
-    ADD("</a>");
-#else
-    ipaddr_add(&r->ipaddr);
+  page_link_piece(arg, s->index, &PIECE(s)->at.addr);
+  if (s->index == 1) OUT("/%u (via ", (unsigned int)PIECE(s)->at.v);
+  else if (s->index == 2) OUT(") %lus\n", (unsigned long)PIECE(s)->at.v);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* Pieces 0 and 1 show the child, piece 2 the parent and the lifetime */
+static void
+link_take(struct httpd_state *s, uint8_t piece)
+{
+  rpl_ns_node_t *link = s->cursor;
+
+  rpl_ns_get_node_global_addr(&PIECE(s)->at.addr, piece < 2 ? link : link->parent);
+  PIECE(s)->at.v = link->lifetime;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+page_ns_link(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  page_link_piece(arg, s->index, &PIECE(s)->at.addr);
+  if (s->index == 1) OUT(" (parent: ");
+  else if (s->index == 2) OUT(") %us\n", (unsigned int)PIECE(s)->at.v); // iotlab printf does not have %lu
+  return out_len(arg);
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+/* The pieces of a node, in the order /status.json lists its fields */
+#define NODE_PIECES 5
+
+static void
+node_take(struct httpd_state *s, uint8_t piece)
+{
+  struct node_stats *n = s->cursor;
+  uint32_t *v = PIECE(s)->v;
+
+  switch (piece)
+  {
+  case 0:
+    uip_ipaddr_copy(&PIECE(s)->at.addr, &n->addr);
+    PIECE(s)->at.v = n->samples;
+    break;
+  case 1:
+    /* An ack can announce a node before its first batch */
+    v[0] = n->samples;
+    v[1] = n->min;
+    v[2] = n->samples == 0 ? 0 : n->sum / (long)n->samples;
+    v[3] = n->max;
+    break;
+  case 2:
+    v[0] = n->lost;
+    v[1] = n->gaps;
+    v[2] = n->duplicates;
+    v[3] = n->restarts;
+    break;
+  case 3:
+    v[0] = n->interval;
+    v[1] = n->interval_since;
+    v[2] = n->last_seen;
+    break;
+  default:
+    v[0] = node_stats_confirmed(n);
+    v[1] = n->acked;
+    v[2] = n->ack_interval;
+    v[3] = n->ack_ms;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Times are clock_seconds() of the border router */
+static unsigned short
+page_node(void *arg)
+{
+  struct httpd_state *s = arg;
+  const uint32_t *v = PIECE(s)->v;
+
+  out_begin(arg);
+  switch (s->index)
+  {
+  case 0:
+    out_ipaddr(&PIECE(s)->at.addr);
+    OUT(" %lu samples", (unsigned long)PIECE(s)->at.v);
+    break;
+  case 1:
+    if (v[0] == 0) OUT("\n");
+    else OUT(", min/mean/max %d/%ld/%d\n", (int)(int32_t)v[1], (long)(int32_t)v[2], (int)(int32_t)v[3]);
+    break;
+  case 2:
+    OUT("  lost %lu in %u gaps, %u duplicates, %u restarts\n", (unsigned long)v[0],
+        (unsigned int)v[1], (unsigned int)v[2], (unsigned int)v[3]);
+    break;
+  case 3:
+    OUT("  interval %us since %lus, last at %lus\n", (unsigned int)v[0], (unsigned long)v[1],
+        (unsigned long)v[2]);
+    break;
+  default:
+    if (v[0]) OUT("  acked version 0x%04x after %lums", (unsigned int)v[1], (unsigned long)v[3]);
+    else OUT("  pending, acked 0x%04x", (unsigned int)v[1]);
+    OUT(" at %us\n", (unsigned int)v[2]);
+    break;
+  }
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+/* Piece 6 is the baud rate alone, for /status.json */
+#define SLIP_PIECES 6
+
+static void
+slip_take(struct httpd_state *s)
+{
+  const struct slip_bridge_stats *st = slip_bridge_stats();
+  uint32_t *v = PIECE(s)->v;
+
+  switch (s->index)
+  {
+  case 0:
+    v[0] = st->rx;
+    v[1] = st->tx;
+    v[2] = slip_bridge_baudrate();
+    break;
+  case 1:
+    v[0] = st->bad_crc;
+    v[1] = st->bad_channel;
+    v[2] = st->runts;
+    break;
+  case 2:
+    v[0] = st->debug_dropped;
+    v[1] = st->tx_dropped;
+    v[2] = st->tx_waits;
+    break;
+  case 3:
+    v[0] = st->flow_stops;
+    v[1] = st->rx_overruns;
+    break;
+  case 4:
+    v[0] = st->compressed;
+    v[1] = st->saved;
+    break;
+  case 5:
+    v[0] = st->forwarded;
+    v[1] = st->bounces;
+    break;
+  default:
+    v[0] = slip_bridge_baudrate();
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+page_slip(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  switch (((struct httpd_state *)arg)->index)
+  {
+  case 0:
+    OUT("SLIP<pre>%lu baud, RX %lu, TX %lu frames\n", (unsigned long)v[2], (unsigned long)v[0],
+        (unsigned long)v[1]);
+    break;
+  case 1:
+    OUT("Bad CRC %lu, bad channel %lu, runts %lu\n", (unsigned long)v[0], (unsigned long)v[1],
+        (unsigned long)v[2]);
+    break;
+  case 2:
+    OUT("Dropped %lu debug lines, %lu frames, waited %lu\n", (unsigned long)v[0],
+        (unsigned long)v[1], (unsigned long)v[2]);
+    break;
+  case 3:
+    OUT("Flow stops %lu, overruns %lu\n", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  case 4:
+    OUT("Compressed %lu headers, saved %lu bytes\n", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  default:
+    OUT("Forwarded %lu to the host, kept %lu from bouncing back</pre>", (unsigned long)v[0],
+        (unsigned long)v[1]);
+    break;
+  }
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+#define DISSEM_PIECES 6
+
+static void
+dissem_take(struct httpd_state *s)
+{
+  const struct config_trickle *t = config_dissem_trickle();
+  const struct config_dissem_stats *st = config_dissem_stats();
+  uint32_t *v = PIECE(s)->v;
+
+  switch (s->index)
+  {
+  case 0:
+    v[0] = config_table_version();
+    v[1] = t->imin;
+    v[2] = t->imax;
+    v[3] = t->k;
+    break;
+  case 1:
+    v[0] = node_stats_pending();
+    v[1] = node_stats_tracked();
+    v[2] = node_stats_dropped();
+    break;
+  case 2:
+    v[0] = st->tx;
+    v[1] = st->suppressed;
+    break;
+  case 3:
+    v[0] = st->consistent;
+    v[1] = st->inconsistent;
+    v[2] = st->resets;
+    break;
+  case 4:
+    v[0] = st->requests;
+    v[1] = st->data;
+    v[2] = st->updates;
+    break;
+  default:
+    v[0] = st->update_msgs;
+    v[1] = st->converge_ms;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+page_trickle(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  switch (((struct httpd_state *)arg)->index)
+  {
+  case 0:
+    OUT("Trickle<pre>Version 0x%04x, Imin %ums, Imax %u, k %u\n", (unsigned int)v[0],
+        (unsigned int)v[1], (unsigned int)v[2], (unsigned int)v[3]);
+    break;
+  case 1:
+    OUT("%u of %u tracked nodes pending, %u dropped unacked\n", (unsigned int)v[0],
+        (unsigned int)v[1], (unsigned int)v[2]);
+    break;
+  case 2:
+    OUT("TX %lu, suppressed %lu, ", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  case 3:
+    OUT("RX consistent %lu, inconsistent %lu, resets %lu\n", (unsigned long)v[0],
+        (unsigned long)v[1], (unsigned long)v[2]);
+    break;
+  case 4:
+    OUT("Requests %lu, data %lu, updates %lu, ", (unsigned long)v[0], (unsigned long)v[1],
+        (unsigned long)v[2]);
+    break;
+  default:
+    OUT("last one took %lu messages, %lums</pre>", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  }
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+#if WEBSERVER_CONF_FILESTATS
+static unsigned short
+page_filestats(void *arg)
+{
+  out_begin(arg);
+  OUT("<br><i>This page sent %u times</i>", ((struct httpd_state *)arg)->index);
+  return out_len(arg);
+}
 #endif
-#else
-#if WEBSERVER_CONF_ROUTE_LINKS
-    ADD("<a href=http://[");
-    ipaddr_add(&r->ipaddr);
-    ADD("]/status.shtml>");
-    SEND_STRING(&s->sout, buf); //TODO: why tunslip6 needs an output here, wpcapslip does not
-    blen = 0;
-    ipaddr_add(&r->ipaddr);
-    ADD("</a>");
-#else
-    ipaddr_add(&r->ipaddr);
+/*---------------------------------------------------------------------------*/
+#if WEBSERVER_CONF_LOADTIME
+static unsigned short
+page_loadtime(void *arg)
+{
+  uint16_t numticks = ((struct httpd_state *)arg)->index;
+
+  out_begin(arg);
+  OUT(" <i>(%u.%02u sec)</i>", numticks / CLOCK_SECOND, (100 * (numticks % CLOCK_SECOND)) / CLOCK_SECOND);
+  return out_len(arg);
+}
+#endif
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(generate_routes(struct httpd_state *s))
+{
+#if WEBSERVER_CONF_FILESTATS
+  static uint16_t numtimes;
+#endif
+#if WEBSERVER_CONF_LOADTIME
+  static clock_time_t numticks;
 #endif
+
+  PSOCK_BEGIN(&s->sout);
+#if WEBSERVER_CONF_LOADTIME
+  numticks = clock_time();
 #endif
-    ADD("/%u (via ", r->length);
-    ipaddr_add(uip_ds6_route_nexthop(r));
-    if (1 || (r->state.lifetime < 600))
+
+  HTTPD_SEND_STRING(s, TOP);
+  for (s->index = 0; s->index < DISSEM_PIECES; s->index++)
+  {
+    dissem_take(s);
+    HTTPD_GENERATOR_SEND(s, page_trickle);
+  }
+  for (s->index = 0; s->index < SLIP_PIECES; s->index++)
+  {
+    slip_take(s);
+    HTTPD_GENERATOR_SEND(s, page_slip);
+  }
+
+  HTTPD_SEND_STRING(s, "Nodes<pre>");
+  for (s->cursor = node_stats_head(); s->cursor != NULL; s->cursor = node_stats_next(s->cursor))
+  {
+    for (s->index = 0; s->index < NODE_PIECES; s->index++)
     {
-      ADD(") %lus\n", (unsigned long)r->state.lifetime);
+      node_take(s, s->index);
+      HTTPD_GENERATOR_SEND(s, page_node);
     }
-    else
+  }
+
+  HTTPD_SEND_STRING(s, "</pre>Neighbors<pre>");
+  for (s->cursor = nbr_table_head(ds6_neighbors); s->cursor != NULL; s->cursor = nbr_table_next(ds6_neighbors, s->cursor))
+  {
+    neighbor_take(s);
+    HTTPD_GENERATOR_SEND(s, page_neighbor);
+  }
+
+  HTTPD_SEND_STRING(s, "</pre>Routes<pre>\n");
+  for (s->cursor = uip_ds6_route_head(); s->cursor != NULL; s->cursor = uip_ds6_route_next(s->cursor))
+  {
+    for (s->index = WEBSERVER_CONF_ROUTE_LINKS ? 0 : 1; s->index < 3; s->index++)
     {
-      ADD(")\n");
+      route_take(s, s->index);
+      HTTPD_GENERATOR_SEND(s, page_route);
     }
-    SEND_STRING(&s->sout, buf);
-#if BUF_USES_STACK
-    bufptr = buf;
-    bufend = bufptr + sizeof(buf);
-#else
-    blen = 0;
-#endif
   }
-  ADD("</pre>");
+  HTTPD_SEND_STRING(s, "</pre>");
 
 #if RPL_WITH_NON_STORING
-  ADD("Links<pre>\n");
-  SEND_STRING(&s->sout, buf);
-#if BUF_USES_STACK
-  bufptr = buf;
-  bufend = bufptr + sizeof(buf);
-#else
-  blen = 0;
-#endif
-  for (link = rpl_ns_node_head(); link != NULL; link = rpl_ns_node_next(link))
+  HTTPD_SEND_STRING(s, "Links<pre>\n");
+  for (s->cursor = rpl_ns_node_head(); s->cursor != NULL; s->cursor = rpl_ns_node_next(s->cursor))
   {
-    if (link->parent != NULL)
+    if (((rpl_ns_node_t *)s->cursor)->parent == NULL) continue;
+    for (s->index = WEBSERVER_CONF_ROUTE_LINKS ? 0 : 1; s->index < 3; s->index++)
     {
-      uip_ipaddr_t child_ipaddr;
-      uip_ipaddr_t parent_ipaddr;
-
-      rpl_ns_get_node_global_addr(&child_ipaddr, link);
-      rpl_ns_get_node_global_addr(&parent_ipaddr, link->parent);
+      link_take(s, s->index);
+      HTTPD_GENERATOR_SEND(s, page_ns_link);
+    }
+  }
+  HTTPD_SEND_STRING(s, "</pre>");
+#endif /* RPL_WITH_NON_STORING */
 
-#if BUF_USES_STACK
-#if WEBSERVER_CONF_ROUTE_LINKS
-      ADD("<a href=http://[");
-      ipaddr_add(&child_ipaddr);
-      ADD("]/status.shtml>");
-      ipaddr_add(&child_ipaddr);
-      ADD("</a>");
-#else
-      ipaddr_add(&child_ipaddr);
-#endif
-#else
-#if WEBSERVER_CONF_ROUTE_LINKS
-      ADD("<a href=http://[");
-      ipaddr_add(&child_ipaddr);
-      ADD("]/status.shtml>");
-      SEND_STRING(&s->sout, buf); //TODO: why tunslip6 needs an output here, wpcapslip does not
-      blen = 0;
-      ipaddr_add(&child_ipaddr);
-      ADD("</a>");
-#else
-      ipaddr_add(&child_ipaddr);
+#if WEBSERVER_CONF_FILESTATS
+  s->index = ++numtimes;
+  HTTPD_GENERATOR_SEND(s, page_filestats);
 #endif
+
+#if WEBSERVER_CONF_LOADTIME
+  /* Kept in s so that a retransmission repeats the same figure */
+  s->index = clock_time() - numticks + 1;
+  HTTPD_GENERATOR_SEND(s, page_loadtime);
 #endif
 
-      ADD(" (parent: ");
-      ipaddr_add(&parent_ipaddr);
-      if (1 || (link->lifetime < 600))
-      {
-        ADD(") %us\n", (unsigned int)link->lifetime); // iotlab printf does not have %lu
-        //ADD(") %lus\n", (unsigned long)r->state.lifetime);
-      }
-      else
+  HTTPD_SEND_STRING(s, BOTTOM);
+
+  PSOCK_END(&s->sout);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * /status.json streams the same state for collectors:
+ *
+ *   {"neighbors":[addr,...],"routes":[[dst,len,via,lifetime],...],
+ *    "links":[[child,parent,lifetime],...],
+ *    "nodes":[{"addr":a,"samples":n,"min":v,"mean":v,"max":v,
+ *              "lost":n,"gaps":n,"duplicates":n,"restarts":n,
+ *              "interval":s,"interval_since":t,"last_seen":t,
+ *              "acked":version,"ack_interval":s,"ack_ms":ms},...],
+ *    "table":[[type,lo,hi,interval,version],...],
+ *    "dissem":{"version":v,"trickle":{"imin":ms,"imax":doublings,"k":k},
+ *              "pending":nodes,"tracked":nodes,"dropped":nodes,
+ *              "stats":{the fields of struct config_dissem_stats by name}},
+ *    "store":[count,stored,duplicates,overwritten,rejected],
+ *    "slip":[the fields of struct slip_bridge_stats],"baud":rate}
+ *
+ * The pieces are taken and printed like those of the status page, and
+ * hold at most one address to stay within the MSS of a small uip_buf.
+ * Nodes and dissemination, which collectors read, have named fields so
+ * that a field added later does not shift the others.
+ *
+ * min, mean and max are null for a node that has acked a version but not
+ * sent a sample yet. pending counts the tracked nodes (see node-stats.h)
+ * that have not acked the version; dropped those that had not when they
+ * made room for others.
+ */
+static void
+json_begin(struct httpd_state *s)
+{
+  out_begin(s);
+  if (s->index > 0) OUT(",");
+}
+/*---------------------------------------------------------------------------*/
+static void
+json_ipaddr(const uip_ipaddr_t *addr)
+{
+  OUT("\"");
+  out_ipaddr(addr);
+  OUT("\"");
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_neighbor(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  json_begin(s);
+  json_ipaddr(&PIECE(s)->at.addr);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_route_dst(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  json_begin(s);
+  OUT("[");
+  json_ipaddr(&PIECE(s)->at.addr);
+  OUT(",%u,", (unsigned int)PIECE(s)->at.v);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+/* Also closes a link, after link_take(s, 2) */
+static unsigned short
+json_route_via(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  out_begin(arg);
+  json_ipaddr(&PIECE(s)->at.addr);
+  OUT(",%lu]", (unsigned long)PIECE(s)->at.v);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+static unsigned short
+json_link_child(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  json_begin(s);
+  OUT("[");
+  json_ipaddr(&PIECE(s)->at.addr);
+  OUT(",");
+  return out_len(arg);
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+static void
+entry_take(struct httpd_state *s)
+{
+  const struct config_entry *e = config_table_get(s->index);
+  uint32_t *v = PIECE(s)->v;
+
+  v[0] = e->sel.type;
+  v[1] = e->sel.lo;
+  v[2] = e->sel.hi;
+  v[3] = e->interval;
+  v[4] = e->version;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_entry(void *arg)
+{
+  struct httpd_state *s = arg;
+  const uint32_t *v = PIECE(s)->v;
+
+  json_begin(s);
+  OUT("[%u,%u,%u,%u,%u]", (unsigned int)v[0], (unsigned int)v[1], (unsigned int)v[2],
+      (unsigned int)v[3], (unsigned int)v[4]);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_dissem(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  switch (((struct httpd_state *)arg)->index)
+  {
+  case 0:
+    OUT("],\"dissem\":{\"version\":%u,\"trickle\":{\"imin\":%u,\"imax\":%u,\"k\":%u},",
+        (unsigned int)v[0],
+        (unsigned int)v[1], (unsigned int)v[2], (unsigned int)v[3]);
+    break;
+  case 1:
+    OUT("\"pending\":%u,\"tracked\":%u,\"dropped\":%u,", (unsigned int)v[0], (unsigned int)v[1],
+        (unsigned int)v[2]);
+    break;
+  case 2:
+    OUT("\"stats\":{\"tx\":%lu,\"suppressed\":%lu,", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  case 3:
+    OUT("\"consistent\":%lu,\"inconsistent\":%lu,\"resets\":%lu,", (unsigned long)v[0],
+        (unsigned long)v[1], (unsigned long)v[2]);
+    break;
+  case 4:
+    OUT("\"requests\":%lu,\"data\":%lu,\"updates\":%lu,", (unsigned long)v[0],
+        (unsigned long)v[1], (unsigned long)v[2]);
+    break;
+  default:
+    OUT("\"update_msgs\":%lu,\"converge_ms\":%lu}}", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  }
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+/* s->index counts the nodes, so each piece of a node has its generator */
+static unsigned short
+json_node_addr(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  json_begin(s);
+  OUT("{\"addr\":");
+  json_ipaddr(&PIECE(s)->at.addr);
+  OUT(",");
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_node_sampled(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  OUT("\"samples\":%lu,", (unsigned long)v[0]);
+  if (v[0] == 0) OUT("\"min\":null,\"mean\":null,\"max\":null,");
+  else OUT("\"min\":%d,\"mean\":%ld,\"max\":%d,", (int)(int32_t)v[1], (long)(int32_t)v[2],
+           (int)(int32_t)v[3]);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_node_lost(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  OUT("\"lost\":%lu,\"gaps\":%u,\"duplicates\":%u,\"restarts\":%u,", (unsigned long)v[0],
+      (unsigned int)v[1], (unsigned int)v[2], (unsigned int)v[3]);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_node_times(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  OUT("\"interval\":%u,\"interval_since\":%lu,\"last_seen\":%lu,", (unsigned int)v[0],
+      (unsigned long)v[1], (unsigned long)v[2]);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_node_acked(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  OUT("\"acked\":%u,\"ack_interval\":%u,\"ack_ms\":%lu}", (unsigned int)v[1], (unsigned int)v[2],
+      (unsigned long)v[3]);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static void
+store_take(struct httpd_state *s)
+{
+  const struct sample_store_stats *st = sample_store_stats();
+  uint32_t *v = PIECE(s)->v;
+
+  v[0] = sample_store_count();
+  v[1] = st->stored;
+  v[2] = st->duplicates;
+  v[3] = st->overwritten;
+  v[4] = st->rejected;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_store(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  OUT(",\"store\":[%u,%lu,%lu,%lu,%lu]", (unsigned int)v[0], (unsigned long)v[1],
+      (unsigned long)v[2], (unsigned long)v[3], (unsigned long)v[4]);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+json_slip(void *arg)
+{
+  const uint32_t *v = PIECE((struct httpd_state *)arg)->v;
+
+  out_begin(arg);
+  switch (((struct httpd_state *)arg)->index)
+  {
+  case 0:
+    OUT(",\"slip\":[%lu,%lu", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  case 1:
+  case 2:
+    OUT(",%lu,%lu,%lu", (unsigned long)v[0], (unsigned long)v[1], (unsigned long)v[2]);
+    break;
+  case 3:
+  case 4:
+    OUT(",%lu,%lu", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  case 5:
+    OUT(",%lu,%lu]", (unsigned long)v[0], (unsigned long)v[1]);
+    break;
+  default:
+    OUT(",\"baud\":%lu}", (unsigned long)v[0]);
+    break;
+  }
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(generate_json(struct httpd_state *s))
+{
+  PSOCK_BEGIN(&s->sout);
+
+  HTTPD_SEND_STRING(s, "{\"neighbors\":[");
+  s->index = 0;
+  for (s->cursor = nbr_table_head(ds6_neighbors); s->cursor != NULL; s->cursor = nbr_table_next(ds6_neighbors, s->cursor))
+  {
+    neighbor_take(s);
+    HTTPD_GENERATOR_SEND(s, json_neighbor);
+    s->index++;
+  }
+
+  HTTPD_SEND_STRING(s, "],\"routes\":[");
+  s->index = 0;
+  for (s->cursor = uip_ds6_route_head(); s->cursor != NULL; s->cursor = uip_ds6_route_next(s->cursor))
+  {
+    route_take(s, 1);
+    HTTPD_GENERATOR_SEND(s, json_route_dst);
+    route_take(s, 2);
+    HTTPD_GENERATOR_SEND(s, json_route_via);
+    s->index++;
+  }
+
+  HTTPD_SEND_STRING(s, "],\"links\":[");
+#if RPL_WITH_NON_STORING
+  s->index = 0;
+  for (s->cursor = rpl_ns_node_head(); s->cursor != NULL; s->cursor = rpl_ns_node_next(s->cursor))
+  {
+    if (((rpl_ns_node_t *)s->cursor)->parent == NULL) continue;
+    link_take(s, 1);
+    HTTPD_GENERATOR_SEND(s, json_link_child);
+    link_take(s, 2);
+    HTTPD_GENERATOR_SEND(s, json_route_via);
+    s->index++;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
+  HTTPD_SEND_STRING(s, "],\"nodes\":[");
+  s->index = 0;
+  for (s->cursor = node_stats_head(); s->cursor != NULL; s->cursor = node_stats_next(s->cursor))
+  {
+    node_take(s, 0);
+    HTTPD_GENERATOR_SEND(s, json_node_addr);
+    node_take(s, 1);
+    HTTPD_GENERATOR_SEND(s, json_node_sampled);
+    node_take(s, 2);
+    HTTPD_GENERATOR_SEND(s, json_node_lost);
+    node_take(s, 3);
+    HTTPD_GENERATOR_SEND(s, json_node_times);
+    node_take(s, 4);
+    HTTPD_GENERATOR_SEND(s, json_node_acked);
+    s->index++;
+  }
+
+  HTTPD_SEND_STRING(s, "],\"table\":[");
+  for (s->index = 0; s->index < config_table_count(); s->index++)
+  {
+    entry_take(s);
+    HTTPD_GENERATOR_SEND(s, json_entry);
+  }
+
+  for (s->index = 0; s->index < DISSEM_PIECES; s->index++)
+  {
+    dissem_take(s);
+    HTTPD_GENERATOR_SEND(s, json_dissem);
+  }
+  store_take(s);
+  HTTPD_GENERATOR_SEND(s, json_store);
+  for (s->index = 0; s->index <= SLIP_PIECES; s->index++)
+  {
+    slip_take(s);
+    HTTPD_GENERATOR_SEND(s, json_slip);
+  }
+
+  PSOCK_END(&s->sout);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * /samples.json sends samples from the store, one line each:
+ *
+ *   [seq,node,index,value,interval]
+ *
+ * seq numbers the samples in the order they arrived and node is the low
+ * 16 bits of the sender's address. The query picks what is sent:
+ *
+ *   node=<id>         only samples from that node
+ *   from=<i>&to=<j>   only sample indices i..j
+ *   last=<n>          the last n samples that pass the above
+ *   since=<seq>       samples that arrived after seq
+ *
+ * The path and query together must fit WEBSERVER_CONF_CFS_PATHLEN, or the
+ * request gets 414; the default of 32 fits two filters.
+ *
+ * A query with last, from or to is answered and the response ends. Any
+ * other stream keeps going as samples arrive. A reader that falls behind
+ * loses the oldest samples rather than holding anything up, and a line
+ * {"lost":n} says how many were overwritten before they could be sent.
+ * A quiet stream sends an empty line now and then to stay open.
+ */
+struct feed_query
+{
+  struct sample_store_record r; /* Being sent */
+  struct sample_filter f;
+  uint8_t follow;
+};
+
+#define FEED(s) ((struct feed_query *)(s)->scratch)
+
+/* Fails to compile if WEBSERVER_CONF_SCRATCH is too small */
+typedef char feed_query_fits[sizeof(struct feed_query) <= HTTPD_SCRATCH ? 1 : -1];
+
+static void
+feed_parse(struct httpd_state *s)
+{
+  struct feed_query *q = FEED(s);
+  char *name, *value;
+  long v, last = -1;
+
+  q->f.flags = 0;
+  q->f.lo = 0;
+  q->f.hi = 0xffff;
+  q->follow = 1;
+  s->index = sample_store_oldest();
+  while (httpd_query_next(&s->query, &name, &value))
+  {
+    if (!parse_number(value, 10, 0xffff, &v)) continue;
+    if (strcmp(name, "node") == 0)
+    {
+      q->f.node = v;
+      q->f.flags |= SAMPLE_FILTER_NODE;
+    }
+    else if (strcmp(name, "from") == 0 || strcmp(name, "to") == 0)
+    {
+      if (name[0] == 'f') q->f.lo = v;
+      else q->f.hi = v;
+      q->f.flags |= SAMPLE_FILTER_INDEX;
+      q->follow = 0;
+    }
+    else if (strcmp(name, "last") == 0)
+    {
+      last = v;
+      q->follow = 0;
+    }
+    else if (strcmp(name, "since") == 0 &&
+             (uint16_t)(sample_store_next() - (v + 1)) <= sample_store_count())
+    {
+      s->index = v + 1;
+    }
+  }
+  if (last >= 0) s->index = sample_store_last(last, &q->f);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+feed_line(void *arg)
+{
+  struct httpd_state *s = arg;
+  const struct sample_store_record *r = &FEED(s)->r;
+
+  out_begin(arg);
+  OUT("[%u,%u,%u,%d,%u]\n", s->index, r->node, r->index, r->value, r->interval);
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+feed_lost(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  out_begin(arg);
+  OUT("{\"lost\":%u}\n", (uint16_t)(sample_store_oldest() - s->index));
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(generate_feed(struct httpd_state *s))
+{
+  PSOCK_BEGIN(&s->sout);
+
+  feed_parse(s);
+  while (1)
+  {
+    if (s->index == sample_store_next())
+    {
+      if (!FEED(s)->follow) break;
+      PSOCK_WAIT_UNTIL(&s->sout, s->index != sample_store_next() || httpd_idle(s));
+      if (s->index == sample_store_next())
       {
-        ADD(")\n");
+        HTTPD_SEND_STRING(s, "\n");
+        continue;
       }
-      SEND_STRING(&s->sout, buf);
-#if BUF_USES_STACK
-      bufptr = buf;
-      bufend = bufptr + sizeof(buf);
-#else
-      blen = 0;
-#endif
     }
+    if ((uint16_t)(sample_store_next() - s->index) > sample_store_count())
+    {
+      HTTPD_GENERATOR_SEND(s, feed_lost);
+      s->index = sample_store_oldest();
+      continue;
+    }
+    s->index = sample_store_find(s->index, &FEED(s)->f);
+    if (s->index == sample_store_next()) continue;
+
+    /* The store may move on before the line is acked */
+    sample_store_get(s->index, &FEED(s)->r);
+    HTTPD_GENERATOR_SEND(s, feed_line);
+    s->index++;
   }
-  ADD("</pre>");
-#endif /* RPL_WITH_NON_STORING */
 
-#if WEBSERVER_CONF_FILESTATS
-  static uint16_t numtimes;
-  ADD("<br><i>This page sent %u times</i>", ++numtimes);
-#endif
+  PSOCK_END(&s->sout);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Commands are the only requests that touch the dissemination, and only
+ * when they change something, so status pages can be polled freely.
+ */
+#define COMMAND_UNCHANGED 0
+#define COMMAND_CHANGED   1
+#define COMMAND_INVALID   2
+#define COMMAND_WAIT      3 /* Still listening for the network's version */
 
-#if WEBSERVER_CONF_LOADTIME
-  numticks = clock_time() - numticks + 1;
-  ADD(" <i>(%u.%02u sec)</i>",numticks/CLOCK_SECOND,(100*(numticks%CLOCK_SECOND))/CLOCK_SECOND));
-#endif
+static unsigned short
+command_result(void *arg)
+{
+  struct httpd_state *s = arg;
+
+  out_begin(arg);
+  if (s->index == COMMAND_INVALID) OUT("<h5>Invalid command</h5>");
+  else if (s->index == COMMAND_WAIT) OUT("<h5>Learning the config version, try again</h5>");
+  else if (HTTPD_PATH(s)[1] == 't')
+  {
+    OUT("<h5>Trickle Imin %ums, Imax %u, k %u</h5>", trickle.imin, trickle.imax, trickle.k);
+  }
+  else
+  {
+    switch (sel.type)
+    {
+    case CONFIG_SEL_NODE:
+      if (sel.lo == CONFIG_NODE_ALL) OUT("<h5>Change all nodes");
+      else OUT("<h5>Change Node [%u]", sel.lo);
+      break;
+    case CONFIG_SEL_RANGE:
+      OUT("<h5>Change Nodes [%u-%u]", sel.lo, sel.hi);
+      break;
+    case CONFIG_SEL_BITMAP:
+      OUT("<h5>Change Nodes [%u+0x%04x]", sel.lo, sel.hi);
+      break;
+    case CONFIG_SEL_RANK:
+      OUT("<h5>Change Nodes at rank [%u-%u]", sel.lo, sel.hi);
+      break;
+    }
+    OUT(" to Interval => %us</h5>", interval);
+  }
+  return out_len(arg);
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(generate_command(struct httpd_state *s))
+{
+  PSOCK_BEGIN(&s->sout);
 
-  SEND_STRING(&s->sout, buf);
-  SEND_STRING(&s->sout, BOTTOM);
+  if (!version_ready()) s->index = COMMAND_WAIT;
+  else if (HTTPD_PATH(s)[1] == 's' && parse_set(s->query))
+  {
+    printf("Interval = '%u' - Selector %u [%u, %u]\n", interval, sel.type, sel.lo, sel.hi);
+    s->index = command_apply();
+  }
+  else if (HTTPD_PATH(s)[1] == 't' && parse_trickle(s->query))
+  {
+    printf("Trickle Imin %ums, Imax %u, k %u\n", trickle.imin, trickle.imax, trickle.k);
+    switch (config_dissem_set_trickle(trickle.imin, trickle.imax, trickle.k))
+    {
+    case 1:
+      s->index = COMMAND_CHANGED;
+      command_save();
+      break;
+    case 0:
+      s->index = COMMAND_UNCHANGED;
+      break;
+    default:
+      s->index = COMMAND_INVALID;
+      break;
+    }
+  }
+  else s->index = COMMAND_INVALID;
 
-  //=============================================
-  // Aquí el Border Route decide la actualización del token
-  packet.node = node;
-  packet.interval = interval;
-  packet.token++;
-  printf("At %lu: Generating a new token 0x%02x\n", (unsigned long)clock_time(), packet.token);
-  trickle_timer_reset_event(&tt);
+  if (s->index == COMMAND_CHANGED) disseminate();
 
-  //=============================================
+  HTTPD_SEND_STRING(s, TOP);
+  HTTPD_GENERATOR_SEND(s, command_result);
+  if (s->index == COMMAND_UNCHANGED) HTTPD_SEND_STRING(s, "Unchanged, nothing disseminated\n");
+  HTTPD_SEND_STRING(s, BOTTOM);
 
   PSOCK_END(&s->sout);
 }
 /*---------------------------------------------------------------------------*/
+static const struct httpd_simple_route routes[] = {
+  { "status.json", generate_json },
+  { "samples.json", generate_feed },
+  { "set", generate_command },
+  { "trickle", generate_command },
+  { "", generate_routes },
+  { NULL, NULL }
+};
+
 httpd_simple_script_t
 httpd_simple_get_script(const char *name)
 {
-  return generate_routes;
+  return httpd_simple_route(routes, name);
 }
 
 #endif /* WEBSERVER */
@@ -494,11 +1425,7 @@ static void print_local_addresses(void)
 /*---------------------------------------------------------------------------*/
 void request_prefix(void)
 {
-  uip_buf[0] = '?';
-  uip_buf[1] = 'P';
-  uip_len = 2;
-  slip_send();
-  uip_len = 0;
+  slip_bridge_send(SLIP_BRIDGE_CONTROL, "?P", 2);
 }
 /*---------------------------------------------------------------------------*/
 static void create_rpl_dag(uip_ipaddr_t *ipaddr);
@@ -526,16 +1453,9 @@ PROCESS_THREAD(border_router_process, ev, data)
   PROCESS_BEGIN();
 
   printf("Trickle protocol started\n");
-  uip_create_linklocal_allnodes_mcast(&ipaddr);
-  
-  trickle_conn = udp_new(NULL, UIP_HTONS(TRICKLE_PROTO_PORT), NULL);
-  udp_bind(trickle_conn, UIP_HTONS(TRICKLE_PROTO_PORT));
+  config_dissem_init(config_adopted);
+  command_restore();
 
-  PRINTF("Connection: local/remote port %u/%u\n", UIP_HTONS(trickle_conn->lport), UIP_HTONS(trickle_conn->rport));
-
-  packet.token = 0;
-  trickle_timer_config(&tt, IMIN, IMAX, REDUNDANCY_CONST);
-  trickle_timer_set(&tt, trickle_tx, &tt);
   prefix_set = 0;
   NETSTACK_MAC.off(0);
   PROCESS_PAUSE();
@@ -547,22 +1467,65 @@ PROCESS_THREAD(border_router_process, ev, data)
 
   while (1) {
     PROCESS_YIELD();
-    if (ev == tcpip_event) tcpip_handler();
+    if (ev == tcpip_event) config_dissem_input();
   }
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
-static void receiver(struct simple_udp_connection *c, const uip_ipaddr_t *sender_addr, uint16_t sender_port, const uip_ipaddr_t *receiver_addr, uint16_t receiver_port, const struct sample *data, uint16_t datalen)
+static void receiver(struct simple_udp_connection *c, const uip_ipaddr_t *sender_addr, uint16_t sender_port, const uip_ipaddr_t *receiver_addr, uint16_t receiver_port, const uint8_t *data, uint16_t datalen)
 {
+  struct sample_batch_reader r;
+  struct sample sample;
+  uint16_t version, acked_interval;
   int i;
   printf("Data received from ");
   uip_debug_ipaddr_print(sender_addr);
   printf(" on port %d from port %d with length %d:\n", receiver_port, sender_port, datalen);
 
-  for (i = 0; i < NSAMPLES; i++)
-    printf("\t[Sample %d]: Value = %d | Index = %d | Interval Used = %d\n", i + 1, data[i].value, data[i].index, data[i].interval);
+  /* The host gets every message as it came, without parsing the console */
+  slip_bridge_begin(SLIP_BRIDGE_TELEMETRY);
+  slip_bridge_write(sender_addr, sizeof(uip_ipaddr_t));
+  slip_bridge_write(data, datalen);
+  slip_bridge_end();
+
+  if (sample_ack_decode(data, datalen, &version, &acked_interval) == 0)
+  {
+    printf("\tConfig version 0x%04x applied, interval %u\n", version, acked_interval);
+    /* Trickle backs off on its own once the network is consistent */
+    if (node_stats_ack(sender_addr, version, acked_interval) == 0 && version == config_table_version())
+    {
+      printf("At %lu: All %u tracked nodes confirmed version 0x%04x", (unsigned long)clock_time(),
+             node_stats_tracked(), version);
+      if (node_stats_dropped() > 0) printf(", %u dropped before they did", node_stats_dropped());
+      printf("\n");
+    }
+    return;
+  }
+
+  if (sample_batch_open(&r, data, datalen) < 0)
+  {
+    printf("\tMalformed sample batch\n");
+    return;
+  }
+  for (i = 1; sample_batch_next(&r, &sample) > 0; i++)
+  {
+    printf("\t[Sample %d]: Value = %d | Index = %d | Interval Used = %d\n", i, sample.value, sample.index, sample.interval);
+    if (node_stats_add(sender_addr, &sample))
+    {
+      printf("\t\tNode restarted\n");
+#if WEBSERVER == 1
+      sample_store_restart(sender_addr);
+#endif
+    }
+#if WEBSERVER == 1
+    if (sample_store_add(sender_addr, &sample) == 0) printf("\t\tAlready stored\n");
+#endif
+  }
+#if WEBSERVER == 1
+  httpd_simple_notify();
+#endif
 }
 /*---------------------------------------------------------------------------*/
 static uip_ipaddr_t *set_global_address(void)
@@ -615,6 +1578,7 @@ PROCESS_THREAD(unicast_receiver_process, ev, data)
   PROCESS_BEGIN();
 
   servreg_hack_init();
+  node_stats_init();
 
   l_ipaddr = set_global_address();
 
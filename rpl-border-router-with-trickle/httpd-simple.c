@@ -42,8 +42,6 @@
 
 #include "contiki-net.h"
 
-//#include "urlconv.h"
-
 #include "httpd-simple.h"
 #define webserver_log_file(...)
 #define webserver_log(...)
@@ -54,21 +52,26 @@
 #define CONNS WEBSERVER_CONF_CFS_CONNS
 #endif /* WEBSERVER_CONF_CFS_CONNS */
 
-#ifndef WEBSERVER_CONF_CFS_URLCONV
-#define URLCONV 0
-#else /* WEBSERVER_CONF_CFS_URLCONV */
-#define URLCONV WEBSERVER_CONF_CFS_URLCONV
-#endif /* WEBSERVER_CONF_CFS_URLCONV */
-
 #define STATE_WAITING 0
 #define STATE_OUTPUT  1
 
+/* Seconds without traffic before a connection is dropped; an idle
+ * persistent connection is closed gracefully instead */
+#ifndef WEBSERVER_CONF_TIMEOUT
+#define TIMEOUT 10
+#else /* WEBSERVER_CONF_TIMEOUT */
+#define TIMEOUT WEBSERVER_CONF_TIMEOUT
+#endif /* WEBSERVER_CONF_TIMEOUT */
+
 MEMB(conns, struct httpd_state, CONNS);
 
 #define ISO_nl      0x0a
 #define ISO_space   0x20
+#define ISO_amp     0x26
 #define ISO_period  0x2e
 #define ISO_slash   0x2f
+#define ISO_eq      0x3d
+#define ISO_qmark   0x3f
 
 /*---------------------------------------------------------------------------*/
 static const char *NOT_FOUND = "<html><body bgcolor=\"white\">"
@@ -77,6 +80,48 @@ static const char *NOT_FOUND = "<html><body bgcolor=\"white\">"
 "</center>"
 "</body>"
 "</html>";
+static const char *URI_TOO_LONG = "<html><body bgcolor=\"white\">"
+"<center>"
+"<h1>414 - path too long</h1>"
+"</center>"
+"</body>"
+"</html>";
+/*---------------------------------------------------------------------------*/
+unsigned short
+httpd_generate(void *state)
+{
+  static const char hex[] = "0123456789abcdef";
+  struct httpd_state *s = (struct httpd_state *)state;
+  char *p = (char *)uip_appdata;
+  unsigned short len;
+
+  len = s->generator(s);
+  if(!s->chunked || len == 0) {
+    return len;
+  }
+  p[0] = hex[(len >> 12) & 0xf];
+  p[1] = hex[(len >> 8) & 0xf];
+  p[2] = hex[(len >> 4) & 0xf];
+  p[3] = hex[len & 0xf];
+  p[4] = '\r';
+  p[5] = '\n';
+  p[HTTPD_CHUNK_HEAD + len] = '\r';
+  p[HTTPD_CHUNK_HEAD + len + 1] = '\n';
+  return HTTPD_CHUNK_HEAD + len + HTTPD_CHUNK_TAIL;
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+httpd_generate_string(void *state)
+{
+  struct httpd_state *s = (struct httpd_state *)state;
+  unsigned short len = strlen(s->string);
+
+  if(len > HTTPD_OUT_LEN(s)) {
+    len = HTTPD_OUT_LEN(s);
+  }
+  memcpy(HTTPD_OUT(s), s->string, len);
+  return len;
+}
 /*---------------------------------------------------------------------------*/
 static
 PT_THREAD(send_string(struct httpd_state *s, const char *str))
@@ -89,10 +134,12 @@ PT_THREAD(send_string(struct httpd_state *s, const char *str))
 }
 /*---------------------------------------------------------------------------*/
 const char http_content_type_html[] = "Content-type: text/html\r\n\r\n";
+const char http_content_type_json[] = "Content-type: application/json\r\n\r\n";
+const char http_json[] = ".json";
 static
 PT_THREAD(send_headers(struct httpd_state *s, const char *statushdr))
 {
-  /* char *ptr; */
+  char *ptr;
 
   PSOCK_BEGIN(&s->sout);
 
@@ -115,81 +162,166 @@ PT_THREAD(send_headers(struct httpd_state *s, const char *statushdr))
   /*   s->ptr = http_content_type_binary; */
   /* } */
   /* SEND_STRING(&s->sout, s->ptr); */
-  SEND_STRING(&s->sout, http_content_type_html);
+  ptr = strrchr(s->inputbuf, ISO_period);
+  if(ptr != NULL && strcmp(http_json, ptr) == 0) {
+    SEND_STRING(&s->sout, http_content_type_json);
+  } else {
+    SEND_STRING(&s->sout, http_content_type_html);
+  }
   PSOCK_END(&s->sout);
 }
 /*---------------------------------------------------------------------------*/
 const char http_header_200[] = "HTTP/1.0 200 OK\r\nServer: Contiki/2.4 http://www.sics.se/contiki/\r\nConnection: close\r\n";
+const char http_header_200_chunked[] = "HTTP/1.1 200 OK\r\nServer: Contiki/2.4 http://www.sics.se/contiki/\r\nTransfer-Encoding: chunked\r\n";
+const char http_last_chunk[] = "0\r\n\r\n";
 const char http_header_404[] = "HTTP/1.0 404 Not found\r\nServer: Contiki/2.4 http://www.sics.se/contiki/\r\nConnection: close\r\n";
+const char http_header_414[] = "HTTP/1.0 414 Request-URI Too Long\r\nServer: Contiki/2.4 http://www.sics.se/contiki/\r\nConnection: close\r\n";
 static
 PT_THREAD(handle_output(struct httpd_state *s))
 {
   PT_BEGIN(&s->outputpt);
 
   s->script = NULL;
-  s->script = httpd_simple_get_script(&s->filename[1]);
+  if(s->inputbuf[0] != 0) {
+    s->script = httpd_simple_get_script(&s->inputbuf[1]);
+  }
   if(s->script == NULL) {
-    strncpy(s->filename, "/notfound.html", sizeof(s->filename));
+    /* An empty path is one that did not fit */
+    s->keepalive = 0;
     PT_WAIT_THREAD(&s->outputpt,
-                   send_headers(s, http_header_404));
+                   send_headers(s, s->inputbuf[0] == 0 ? http_header_414 : http_header_404));
     PT_WAIT_THREAD(&s->outputpt,
-                   send_string(s, NOT_FOUND));
+                   send_string(s, s->inputbuf[0] == 0 ? URI_TOO_LONG : NOT_FOUND));
     uip_close();
     webserver_log_file(&uip_conn->ripaddr, "404 - not found");
     PT_EXIT(&s->outputpt);
+  } else if(s->keepalive) {
+    PT_WAIT_THREAD(&s->outputpt,
+                   send_headers(s, http_header_200_chunked));
+    s->chunked = 1;
+    PT_WAIT_THREAD(&s->outputpt, s->script(s));
+    s->chunked = 0;
+    PT_WAIT_THREAD(&s->outputpt,
+                   send_string(s, http_last_chunk));
   } else {
     PT_WAIT_THREAD(&s->outputpt,
                    send_headers(s, http_header_200));
     PT_WAIT_THREAD(&s->outputpt, s->script(s));
   }
   s->script = NULL;
+  if(s->keepalive) {
+    /* Ready for the next request on this connection */
+    s->state = STATE_WAITING;
+    uip_restart();
+    PT_EXIT(&s->outputpt);
+  }
   PSOCK_CLOSE(&s->sout);
   PT_END(&s->outputpt);
 }
 /*---------------------------------------------------------------------------*/
+/* Case-insensitive match of a lowercase prefix */
+static int
+has_prefix(const char *str, const char *prefix)
+{
+  for(; *prefix != 0; str++, prefix++) {
+    if((*str | 0x20) != *prefix) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 const char http_get[] = "GET ";
-const char http_index_html[] = "/index.html";
+const char http_11[] = "HTTP/1.1";
+const char http_connection[] = "connection:";
+const char http_close[] = "close";
 //const char http_referer[] = "Referer:"
 static
 PT_THREAD(handle_input(struct httpd_state *s))
 {
+  char *line, *value;
+
   PSOCK_BEGIN(&s->sin);
 
-  PSOCK_READTO(&s->sin, ISO_space);
+  /* Requests are served one after the other: the next one is read once
+   * the response to this one has been sent, so pipelined requests are
+   * answered in order */
+  while(1) {
+    /* The path stays at the start of inputbuf until the response has been
+     * sent. Whatever follows it is read into the rest of the buffer. */
+    s->sin.bufptr = (uint8_t *)s->inputbuf;
+    s->sin.bufsize = HTTPD_PATHLEN;
+    PSOCK_READTO(&s->sin, ISO_space);
 
-  if(strncmp(s->inputbuf, http_get, 4) != 0) {
-    PSOCK_CLOSE_EXIT(&s->sin);
-  }
-  PSOCK_READTO(&s->sin, ISO_space);
+    if(strncmp(s->inputbuf, http_get, 4) != 0) {
+      PSOCK_CLOSE_EXIT(&s->sin);
+    }
+    PSOCK_READTO(&s->sin, ISO_space);
 
-  if(s->inputbuf[0] != ISO_slash) {
-    PSOCK_CLOSE_EXIT(&s->sin);
-  }
+    if(s->inputbuf[0] != ISO_slash) {
+      /* Not a path */
+      PSOCK_CLOSE_EXIT(&s->sin);
+    }
+    if(s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] != ISO_space) {
+      /* Longer than HTTPD_PATHLEN: the rest of it was skipped. The request
+       * is read to its end as usual and answered with 414. */
+      s->inputbuf[0] = 0;
+      s->query = NULL;
+    } else {
+      s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] = 0;
+      s->query = strchr(s->inputbuf, ISO_qmark);
+      if(s->query != NULL) {
+        *s->query++ = 0;
+      }
+    }
+    s->sin.bufptr = (uint8_t *)s->inputbuf + PSOCK_DATALEN(&s->sin);
+    s->sin.bufsize = sizeof(s->inputbuf) - 1 - PSOCK_DATALEN(&s->sin);
 
-#if URLCONV
-  s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] = 0;
-  urlconv_tofilename(s->filename, s->inputbuf, sizeof(s->filename));
-#else /* URLCONV */
-  if(s->inputbuf[1] == ISO_space) {
-    strncpy(s->filename, http_index_html, sizeof(s->filename));
-  } else {
-    s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] = 0;
-    strncpy(s->filename, s->inputbuf, sizeof(s->filename));
-  }
-#endif /* URLCONV */
+    webserver_log_file(&uip_conn->ripaddr, s->inputbuf);
 
-  webserver_log_file(&uip_conn->ripaddr, s->filename);
+    /* HTTP/1.1 connections persist unless the client says otherwise */
+    PSOCK_READTO(&s->sin, ISO_nl);
+    s->keepalive = strncmp((char *)s->sin.bufptr, http_11, sizeof(http_11) - 1) == 0;
 
-  s->state = STATE_OUTPUT;
+    /* Headers up to the empty line. Lines longer than inputbuf arrive in
+     * pieces, so only a piece that starts a line is looked at. */
+    s->newline = 1;
+    while(1) {
+      PSOCK_READTO(&s->sin, ISO_nl);
+      if(s->newline && PSOCK_DATALEN(&s->sin) <= 2 && s->sin.bufptr[PSOCK_DATALEN(&s->sin) - 1] == ISO_nl) {
+        break;
+      }
+      line = (char *)s->sin.bufptr;
+      if(s->newline && has_prefix(line, http_connection)) {
+        line[PSOCK_DATALEN(&s->sin) - 1] = 0;
+        for(value = &line[sizeof(http_connection) - 1]; *value == ISO_space; value++);
+        if(has_prefix(value, http_close)) {
+          s->keepalive = 0;
+        }
+      }
+      s->newline = line[PSOCK_DATALEN(&s->sin) - 1] == ISO_nl;
+    }
 
-  while(1) {
-    PSOCK_READTO(&s->sin, ISO_nl);
-#if 0
-    if(strncmp(s->inputbuf, http_referer, 8) == 0) {
-      s->inputbuf[PSOCK_DATALEN(&s->sin) - 2] = 0;
-      webserver_log(s->inputbuf);
+    /* The response is about to overwrite uip_buf. A pipelined request that
+     * came in the same segment moves to inputbuf, after the path, to be
+     * read once the response has been sent. If it does not fit, the
+     * connection closes after this response and the client sends it again. */
+    if(s->sin.readlen > 0 && s->keepalive) {
+      if(s->sin.readlen <= s->inputbuf + sizeof(s->inputbuf) - (char *)s->sin.bufptr) {
+        memcpy(s->sin.bufptr, s->sin.readptr, s->sin.readlen);
+        s->sin.readptr = s->sin.bufptr;
+      } else {
+        s->keepalive = 0;
+      }
+    }
+    if(!s->keepalive) {
+      s->sin.readlen = 0;
     }
-#endif
+    /* Anything sent during the response waits in the client, which sees a
+     * closed window, rather than being acked and lost */
+    uip_stop();
+    s->state = STATE_OUTPUT;
+    PSOCK_WAIT_UNTIL(&s->sin, s->state == STATE_WAITING);
   }
 
   PSOCK_END(&s->sin);
@@ -201,6 +333,10 @@ handle_connection(struct httpd_state *s)
   handle_input(s);
   if(s->state == STATE_OUTPUT) {
     handle_output(s);
+    if(s->state == STATE_WAITING) {
+      /* The next request may be waiting in inputbuf */
+      handle_input(s);
+    }
   }
 }
 
@@ -228,15 +364,24 @@ httpd_appcall(void *state)
     PT_INIT(&s->outputpt);
     s->script = NULL;
     s->state = STATE_WAITING;
-    timer_set(&s->timer, CLOCK_SECOND * 10);
+    s->keepalive = 0;
+    s->chunked = 0;
+    timer_set(&s->timer, CLOCK_SECOND * TIMEOUT);
     handle_connection(s);
   } else if(s != NULL) {
     if(uip_poll()) {
       if(timer_expired(&s->timer)) {
+        if(s->state == STATE_WAITING && s->keepalive) {
+          /* Idle between requests */
+          uip_close();
+          webserver_log_file(&uip_conn->ripaddr, "close (idle)");
+          return;
+        }
         uip_abort();
         s->script = NULL;
         memb_free(&conns, s);
         webserver_log_file(&uip_conn->ripaddr, "reset (timeout)");
+        return;
       }
     } else {
       timer_restart(&s->timer);
@@ -247,6 +392,66 @@ httpd_appcall(void *state)
   }
 }
 
+/*---------------------------------------------------------------------------*/
+httpd_simple_script_t
+httpd_simple_route(const struct httpd_simple_route *routes, const char *name)
+{
+  size_t len;
+
+  for(; routes->prefix != NULL; routes++) {
+    len = strlen(routes->prefix);
+    if(strncmp(name, routes->prefix, len) == 0 &&
+       (len == 0 || name[len] == 0 || name[len] == ISO_slash)) {
+      return routes->script;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+httpd_query_next(char **query, char **name, char **value)
+{
+  char *p = *query;
+
+  if(p == NULL || *p == 0) {
+    return 0;
+  }
+  *name = p;
+  *value = NULL;
+  for(; *p != 0 && *p != ISO_amp; p++) {
+    if(*p == ISO_eq && *value == NULL) {
+      *p = 0;
+      *value = p + 1;
+    }
+  }
+  if(*value == NULL) {
+    *value = p;
+  }
+  if(*p == ISO_amp) {
+    *p++ = 0;
+  }
+  *query = p;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+httpd_simple_notify(void)
+{
+  struct uip_conn *c;
+
+  for(c = &uip_conns[0]; c < &uip_conns[UIP_CONNS]; c++) {
+    if(c->lport == UIP_HTONS(80) &&
+       (c->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+      tcpip_poll_tcp(c);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+httpd_idle(struct httpd_state *s)
+{
+  return timer_remaining(&s->timer) < CLOCK_SECOND * TIMEOUT / 2;
+}
 /*---------------------------------------------------------------------------*/
 void
 httpd_init(void)
@@ -254,8 +459,5 @@ httpd_init(void)
 
   tcp_listen(UIP_HTONS(80));
   memb_init(&conns);
-#if URLCONV
-  urlconv_init();
-#endif /* URLCONV */
 }
 /*---------------------------------------------------------------------------*/
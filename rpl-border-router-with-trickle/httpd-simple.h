@@ -42,33 +42,107 @@
 
 #include "contiki-net.h"
 
-/* The current internal border router webserver ignores the requested file name */
-/* and needs no per-connection output buffer, so save some RAM */
+/* The request path is kept in place in inputbuf, so a longer path only
+ * costs its own length, once per connection. A longer path gets 414.
+ * There is no per-connection output buffer. */
 #ifndef WEBSERVER_CONF_CFS_PATHLEN
 #define HTTPD_PATHLEN 6
-#else /* WEBSERVER_CONF_CFS_CONNS */
+#else /* WEBSERVER_CONF_CFS_PATHLEN */
 #define HTTPD_PATHLEN WEBSERVER_CONF_CFS_PATHLEN
-#endif /* WEBSERVER_CONF_CFS_CONNS */
+#endif /* WEBSERVER_CONF_CFS_PATHLEN */
+
+/* Room for a script to keep a copy of what it is sending */
+#ifndef WEBSERVER_CONF_SCRATCH
+#define HTTPD_SCRATCH 8
+#else /* WEBSERVER_CONF_SCRATCH */
+#define HTTPD_SCRATCH WEBSERVER_CONF_SCRATCH
+#endif /* WEBSERVER_CONF_SCRATCH */
 
 struct httpd_state;
 typedef char (* httpd_simple_script_t)(struct httpd_state *s);
 
+/* On a persistent connection every segment of a response is a chunk,
+ * framed as "%04x\r\n" <data> "\r\n" */
+#define HTTPD_CHUNK_HEAD 6
+#define HTTPD_CHUNK_TAIL 2
+
 struct httpd_state {
   struct timer timer;
   struct psock sin, sout;
   struct pt outputpt;
+  /* The path of the current request, then room to read the rest into */
   char inputbuf[HTTPD_PATHLEN + 24];
 /*char outputbuf[UIP_TCP_MSS]; */
-  char filename[HTTPD_PATHLEN];
+  char *query; /* What followed '?' in the path, or NULL */
   httpd_simple_script_t script;
   char state;
+  char keepalive; /* Wait for another request after this one */
+  char chunked;   /* The response is being sent in chunks */
+  char newline;   /* The last header read ended a line */
+  /* Position of a script that generates its output piece by piece */
+  void *cursor;
+  uint16_t index;
+  unsigned short (* generator)(void *state);
+  const char *string;
+  /* What the generator sends when the data it came from can change
+   * before TCP has it acked */
+  uint8_t scratch[HTTPD_SCRATCH];
 };
 
 void httpd_init(void);
 void httpd_appcall(void *state);
 
+/* The path of the current request, without its query */
+#define HTTPD_PATH(s) ((const char *)(s)->inputbuf)
+
+/* name is the path without its leading '/' */
 httpd_simple_script_t httpd_simple_get_script(const char *name);
 
+/* Maps a path prefix, matched up to a '/' or the end of the name, to a
+ * script. Tables end with a NULL prefix; "" matches every name. */
+struct httpd_simple_route {
+  const char *prefix;
+  httpd_simple_script_t script;
+};
+
+httpd_simple_script_t httpd_simple_route(const struct httpd_simple_route *routes,
+                                         const char *name);
+
+/* Splits the next name=value pair off *query, in place. Returns 0 once
+ * there are none left. value is "" for a pair without '=' */
+int httpd_query_next(char **query, char **name, char **value);
+
+/* Wakes the scripts of every connection now rather than at the next
+ * periodic poll, for those that wait for new data to send */
+void httpd_simple_notify(void);
+
+/* True once a connection has been quiet for half its timeout. A script
+ * that waits for data sends something then to keep the connection open. */
+int httpd_idle(struct httpd_state *s);
+
 #define SEND_STRING(s, str) PSOCK_SEND(s, (uint8_t *)str, strlen(str))
 
+/*
+ * Scripts send their output through these so that the server can frame
+ * it. Each call sends one segment: a generator writes at most
+ * HTTPD_OUT_LEN(s) bytes at HTTPD_OUT(s) and returns how many it wrote,
+ * and must write the same again when TCP asks for a retransmission.
+ */
+#define HTTPD_OUT(s) ((char *)uip_appdata + ((s)->chunked ? HTTPD_CHUNK_HEAD : 0))
+#define HTTPD_OUT_LEN(s) (uip_mss() - ((s)->chunked ? HTTPD_CHUNK_HEAD + HTTPD_CHUNK_TAIL : 0))
+
+unsigned short httpd_generate(void *state);
+unsigned short httpd_generate_string(void *state);
+
+#define HTTPD_GENERATOR_SEND(s, gen)                               \
+  do {                                                             \
+    (s)->generator = (gen);                                        \
+    PSOCK_GENERATOR_SEND(&(s)->sout, httpd_generate, s);           \
+  } while(0)
+#define HTTPD_SEND_STRING(s, str)                                  \
+  do {                                                             \
+    (s)->string = (str);                                           \
+    HTTPD_GENERATOR_SEND(s, httpd_generate_string);                \
+  } while(0)
+
 #endif /* HTTPD_SIMPLE_H_ */
@@ -0,0 +1,177 @@
+#include "contiki.h"
+#include "net/ip/uip.h"
+
+#include "node-stats.h"
+
+#include <string.h>
+
+static struct node_stats table[NODE_STATS_LEN];
+
+/* The version the root disseminated last, and when */
+static uint16_t version;
+static uint8_t versioned;
+static unsigned long version_s;
+static clock_time_t version_t;
+static uint8_t dropped; /* Unconfirmed nodes that made room since then */
+
+/*---------------------------------------------------------------------------*/
+static struct node_stats *
+lookup(const uip_ipaddr_t *addr)
+{
+  struct node_stats *n, *lru = NULL;
+
+  for (n = table; n < &table[NODE_STATS_LEN]; n++)
+  {
+    if (!n->used || uip_ipaddr_cmp(&n->addr, addr)) break;
+    if (lru == NULL || n->last_seen < lru->last_seen) lru = n;
+  }
+  if (n == &table[NODE_STATS_LEN])
+  {
+    n = lru;
+    if (versioned && !node_stats_confirmed(n) && dropped < 0xff) dropped++;
+  }
+  else if (n->used) return n;
+
+  memset(n, 0, sizeof(*n));
+  uip_ipaddr_copy(&n->addr, addr);
+  n->used = 1;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+void
+node_stats_init(void)
+{
+  memset(table, 0, sizeof(table));
+  versioned = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+node_stats_add(const uip_ipaddr_t *sender, const struct sample *s)
+{
+  struct node_stats *n = lookup(sender);
+  uint16_t index = s->index;
+  uint16_t ahead = index - n->last_index;
+  int restarted = 0;
+
+  n->last_seen = clock_seconds();
+  if (n->samples > 0)
+  {
+    if ((index == 1 && n->last_index > 1) ||
+        (ahead >= 0x8000 && (uint16_t)-ahead > NODE_STATS_RESTART_JUMP))
+    {
+      n->restarts++;
+      restarted = 1;
+    }
+    else if (ahead == 0 || ahead >= 0x8000)
+    {
+      n->duplicates++;
+      return 0;
+    }
+    else if (ahead > 1)
+    {
+      n->lost += ahead - 1;
+      n->gaps++;
+    }
+  }
+
+  if (n->samples == 0 || s->value < n->min) n->min = s->value;
+  if (n->samples == 0 || s->value > n->max) n->max = s->value;
+  if (n->samples == 0 || s->interval != n->interval)
+  {
+    n->interval = s->interval;
+    n->interval_since = n->last_seen;
+  }
+  n->sum += s->value;
+  n->samples++;
+  n->last_index = index;
+  return restarted;
+}
+/*---------------------------------------------------------------------------*/
+void
+node_stats_version(uint16_t v)
+{
+  version = v;
+  versioned = 1;
+  dropped = 0;
+  version_s = clock_seconds();
+  version_t = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+since_version_ms(void)
+{
+  unsigned long s = clock_seconds() - version_s;
+
+  /* Ticks are exact but a 16-bit clock wraps, so past a minute seconds do */
+  if (s < 60) return ((unsigned long)(clock_time_t)(clock_time() - version_t) * 1000) / CLOCK_SECOND;
+  return s * 1000;
+}
+/*---------------------------------------------------------------------------*/
+int
+node_stats_confirmed(const struct node_stats *n)
+{
+  return versioned && n->acked == version && n->ack_ms != 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+node_stats_ack(const uip_ipaddr_t *sender, uint16_t v, uint16_t interval)
+{
+  struct node_stats *n = lookup(sender);
+
+  n->last_seen = clock_seconds();
+  n->ack_interval = interval;
+  /* The first ack of a version times it, repeats of it change nothing */
+  if (v != n->acked || n->ack_ms == 0)
+  {
+    n->acked = v;
+    n->ack_ms = versioned && v == version ? since_version_ms() + 1 : 0;
+  }
+  return node_stats_pending();
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+node_stats_pending(void)
+{
+  struct node_stats *n;
+  uint8_t pending = 0;
+
+  if (!versioned) return 0;
+  for (n = node_stats_head(); n != NULL; n = node_stats_next(n))
+  {
+    if (!node_stats_confirmed(n)) pending++;
+  }
+  return pending;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+node_stats_tracked(void)
+{
+  struct node_stats *n;
+  uint8_t tracked = 0;
+
+  for (n = node_stats_head(); n != NULL; n = node_stats_next(n)) tracked++;
+  return tracked;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+node_stats_dropped(void)
+{
+  return dropped;
+}
+/*---------------------------------------------------------------------------*/
+struct node_stats *
+node_stats_next(struct node_stats *n)
+{
+  for (n++; n < &table[NODE_STATS_LEN]; n++)
+  {
+    if (n->used) return n;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+struct node_stats *
+node_stats_head(void)
+{
+  return table[0].used ? &table[0] : node_stats_next(&table[0]);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,89 @@
+/**
+ * \file
+ *         Running statistics of the samples from each node, kept by the
+ *         border router to check loss and the interval nodes really use,
+ *         and which nodes have acked the current config version.
+ */
+
+#ifndef NODE_STATS_H_
+#define NODE_STATS_H_
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+
+#include "sample-batch.h"
+
+/* Nodes tracked at once. The one heard from least recently makes room,
+ * so in a larger network the counts below cover the tracked nodes only. */
+#ifdef NODE_STATS_CONF_LEN
+#define NODE_STATS_LEN NODE_STATS_CONF_LEN
+#else
+#define NODE_STATS_LEN 8
+#endif
+
+/* How far behind the last index a sample may be and still count as a
+ * duplicate. A resent batch is at most a few frames behind. */
+#ifdef NODE_STATS_CONF_RESTART_JUMP
+#define NODE_STATS_RESTART_JUMP NODE_STATS_CONF_RESTART_JUMP
+#else
+#define NODE_STATS_RESTART_JUMP 256
+#endif
+
+/*
+ * Nodes number their samples 1, 2, ... so a jump in the index is loss.
+ * An index not past the last one is a duplicate, unless it is 1 or more
+ * than NODE_STATS_RESTART_JUMP behind: the node restarted, and if its
+ * first batches were lost it does not start at 1 here. Indices compare
+ * modulo 2^16, so a 16-bit counter that wraps is not a restart.
+ */
+struct node_stats
+{
+  uip_ipaddr_t addr;
+  uint32_t samples;
+  int32_t sum;
+  int16_t min;
+  int16_t max;
+  uint16_t last_index;
+  uint32_t lost;       /* Indices skipped */
+  uint16_t gaps;       /* Runs of skipped indices */
+  uint16_t duplicates;
+  uint16_t restarts;
+  uint16_t interval;          /* Of the last sample */
+  unsigned long interval_since; /* clock_seconds() of the first at that interval */
+  unsigned long last_seen;      /* clock_seconds() */
+  uint16_t acked;        /* The config version last acked */
+  uint16_t ack_interval; /* The interval the node said it uses with it */
+  uint32_t ack_ms;       /* From dissemination to the first ack, or 0 */
+  uint8_t used;
+};
+
+void node_stats_init(void);
+/* Returns 1 when the sample shows that the node restarted */
+int node_stats_add(const uip_ipaddr_t *sender, const struct sample *s);
+
+/* The root disseminates version: every node is pending until it acks it */
+void node_stats_version(uint16_t version);
+
+/* A node acked version, and samples every interval seconds as a result.
+ * Returns the number of nodes still pending. */
+uint8_t node_stats_ack(const uip_ipaddr_t *sender, uint16_t version, uint16_t interval);
+
+/* Tracked nodes that have not acked the current version */
+uint8_t node_stats_pending(void);
+
+/* Nodes tracked now */
+uint8_t node_stats_tracked(void);
+
+/* Nodes dropped to make room before they acked the current version. They
+ * may have acked since; the root cannot tell, so while this is not 0 it
+ * does not know that every node has the version. */
+uint8_t node_stats_dropped(void);
+
+/* The node has acked the version the root disseminated last */
+int node_stats_confirmed(const struct node_stats *n);
+
+/* Iterates over the nodes heard from, in no particular order */
+struct node_stats *node_stats_head(void);
+struct node_stats *node_stats_next(struct node_stats *n);
+
+#endif /* NODE_STATS_H_ */
@@ -60,8 +60,31 @@
 #define UIP_CONF_RECEIVE_WINDOW  60
 #endif
 
+/* slip-bridge.c hands the UART a burst at a time; let the driver send it
+ * from its interrupt instead of waiting on each byte */
+#ifndef UART0_CONF_TX_WITH_INTERRUPT
+#define UART0_CONF_TX_WITH_INTERRUPT 1
+#endif
+#ifndef UART1_CONF_TX_WITH_INTERRUPT
+#define UART1_CONF_TX_WITH_INTERRUPT 1
+#endif
+
 #ifndef WEBSERVER_CONF_CFS_CONNS
-#define WEBSERVER_CONF_CFS_CONNS 2
+#define WEBSERVER_CONF_CFS_CONNS 4
+#endif
+
+/* Room for commands like /trickle?imin=1000&imax=16&k=10 and two
+ * /samples.json filters, with the space after the path. Each byte is
+ * taken once per connection; 68 fits every filter at once:
+ * /samples.json?node=65535&from=65535&to=65535&last=65535&since=65535 */
+#ifndef WEBSERVER_CONF_CFS_PATHLEN
+#define WEBSERVER_CONF_CFS_PATHLEN 32
+#endif
+
+/* What a segment of the status pages shows, an address and a counter,
+ * or a sample and the query it answers for /samples.json */
+#ifndef WEBSERVER_CONF_SCRATCH
+#define WEBSERVER_CONF_SCRATCH 20
 #endif
 
 #endif /* PROJECT_ROUTER_CONF_H_ */
@@ -0,0 +1,206 @@
+#include "contiki.h"
+#include "net/ip/uip.h"
+
+#include "sample-store.h"
+
+#include <string.h>
+
+#define NO_SENDER 0xff
+
+/* One column per field, indexed by slot */
+static uint8_t col_sender[SAMPLE_STORE_LEN];
+static uint16_t col_index[SAMPLE_STORE_LEN];
+static int16_t col_value[SAMPLE_STORE_LEN];
+static uint16_t col_interval[SAMPLE_STORE_LEN];
+
+static uip_ipaddr_t senders[SAMPLE_STORE_SENDERS];
+static uint16_t sender_count[SAMPLE_STORE_SENDERS]; /* Its samples stored */
+static uint8_t sender_retired[SAMPLE_STORE_SENDERS]; /* Of an earlier generation */
+
+static uint16_t first; /* Slot of the oldest sample */
+static uint16_t count;
+static uint16_t next;  /* Sequence number of the next sample */
+static struct sample_store_stats stats;
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+slot(uint16_t seq)
+{
+  return (first + (uint16_t)(seq - (uint16_t)(next - count))) % SAMPLE_STORE_LEN;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+node(uint8_t sender)
+{
+  return (senders[sender].u8[14] << 8) | senders[sender].u8[15];
+}
+/*---------------------------------------------------------------------------*/
+static int
+in_store(uint16_t seq)
+{
+  return (uint16_t)(next - seq - 1) < count;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pass(uint16_t i, const struct sample_filter *f)
+{
+  if ((f->flags & SAMPLE_FILTER_NODE) && node(col_sender[i]) != f->node) return 0;
+  if ((f->flags & SAMPLE_FILTER_INDEX) && (col_index[i] < f->lo || col_index[i] > f->hi)) return 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+sender_lookup(const uip_ipaddr_t *addr)
+{
+  uint8_t i, free = NO_SENDER;
+
+  for (i = 0; i < SAMPLE_STORE_SENDERS; i++)
+  {
+    if (sender_count[i] == 0)
+    {
+      if (free == NO_SENDER) free = i;
+    }
+    else if (!sender_retired[i] && uip_ipaddr_cmp(&senders[i], addr)) return i;
+  }
+  if (free != NO_SENDER)
+  {
+    uip_ipaddr_copy(&senders[free], addr);
+    sender_retired[free] = 0;
+  }
+  return free;
+}
+/*---------------------------------------------------------------------------*/
+void
+sample_store_restart(const uip_ipaddr_t *sender)
+{
+  uint8_t i;
+
+  /* The samples of the old generation stay, under the same address, and
+   * are only found by queries */
+  for (i = 0; i < SAMPLE_STORE_SENDERS; i++)
+  {
+    if (sender_count[i] > 0 && !sender_retired[i] && uip_ipaddr_cmp(&senders[i], sender))
+    {
+      sender_retired[i] = 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+sample_store_init(void)
+{
+  first = 0;
+  count = 0;
+  next = 0;
+  memset(sender_count, 0, sizeof(sender_count));
+  memset(&stats, 0, sizeof(stats));
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_store_add(const uip_ipaddr_t *sender, const struct sample *s)
+{
+  uint16_t i, n;
+  uint8_t id;
+
+  id = sender_lookup(sender);
+  if (id == NO_SENDER)
+  {
+    stats.rejected++;
+    return -1;
+  }
+
+  /* Retransmitted batches repeat indices the store already has. Only the
+   * current generation is looked at. */
+  if (sender_count[id] > 0)
+  {
+    for (i = first, n = 0; n < count; n++, i = (i + 1) % SAMPLE_STORE_LEN)
+    {
+      if (col_sender[i] == id && col_index[i] == (uint16_t)s->index)
+      {
+        stats.duplicates++;
+        return 0;
+      }
+    }
+  }
+
+  if (count == SAMPLE_STORE_LEN)
+  {
+    sender_count[col_sender[first]]--;
+    first = (first + 1) % SAMPLE_STORE_LEN;
+    count--;
+    stats.overwritten++;
+  }
+  i = (first + count) % SAMPLE_STORE_LEN;
+  col_sender[i] = id;
+  col_index[i] = s->index;
+  col_value[i] = s->value;
+  col_interval[i] = s->interval;
+  sender_count[id]++;
+  count++;
+  next++;
+  stats.stored++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+sample_store_next(void)
+{
+  return next;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+sample_store_oldest(void)
+{
+  return next - count;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+sample_store_count(void)
+{
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_store_get(uint16_t seq, struct sample_store_record *r)
+{
+  uint16_t i;
+
+  if (!in_store(seq)) return 0;
+  i = slot(seq);
+  r->node = node(col_sender[i]);
+  r->index = col_index[i];
+  r->value = col_value[i];
+  r->interval = col_interval[i];
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+sample_store_find(uint16_t seq, const struct sample_filter *f)
+{
+  if (seq != next && !in_store(seq)) seq = sample_store_oldest();
+  for (; seq != next; seq++)
+  {
+    if (pass(slot(seq), f)) break;
+  }
+  return seq;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+sample_store_last(uint16_t n, const struct sample_filter *f)
+{
+  uint16_t seq = next;
+
+  while (n > 0 && seq != sample_store_oldest())
+  {
+    seq--;
+    if (pass(slot(seq), f)) n--;
+  }
+  return seq;
+}
+/*---------------------------------------------------------------------------*/
+const struct sample_store_stats *
+sample_store_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,92 @@
+/**
+ * \file
+ *         Samples received by the border router, kept for collectors.
+ *
+ *         The store is a ring in arrival order. Each sample gets a 16-bit
+ *         sequence number, and the oldest is overwritten when the ring is
+ *         full. Fields are kept in separate columns and senders in a small
+ *         table, so a sample costs 7 bytes with no padding.
+ *
+ *         A node numbers its samples from 1 again after a restart. The
+ *         sender then starts a new generation with its own table entry,
+ *         so new samples are not taken for duplicates of old ones still
+ *         in the store; the old entry goes once its samples have.
+ */
+
+#ifndef SAMPLE_STORE_H_
+#define SAMPLE_STORE_H_
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+
+#include "sample-batch.h"
+
+#ifdef SAMPLE_STORE_CONF_LEN
+#define SAMPLE_STORE_LEN SAMPLE_STORE_CONF_LEN
+#else
+#define SAMPLE_STORE_LEN 64
+#endif
+
+/* Senders with samples in the store at the same time */
+#ifdef SAMPLE_STORE_CONF_SENDERS
+#define SAMPLE_STORE_SENDERS SAMPLE_STORE_CONF_SENDERS
+#else
+#define SAMPLE_STORE_SENDERS 8
+#endif
+
+/* node is the low 16 bits of the sender's address */
+struct sample_store_record
+{
+  uint16_t node;
+  uint16_t index;
+  int16_t value;
+  uint16_t interval;
+};
+
+#define SAMPLE_FILTER_NODE  0x01 /* Only samples from node */
+#define SAMPLE_FILTER_INDEX 0x02 /* Only sample indices lo..hi */
+
+struct sample_filter
+{
+  uint16_t node;
+  uint16_t lo;
+  uint16_t hi;
+  uint8_t flags;
+};
+
+struct sample_store_stats
+{
+  uint32_t stored;
+  uint32_t duplicates;  /* Already stored, from a retransmitted batch */
+  uint32_t overwritten; /* Pushed out by newer samples */
+  uint32_t rejected;    /* No room in the sender table */
+};
+
+void sample_store_init(void);
+
+/* Returns 1 if the sample was stored, 0 if it already was, -1 if the
+ * sender table is full of senders with samples in the store */
+int sample_store_add(const uip_ipaddr_t *sender, const struct sample *s);
+
+/* The sender restarted: its next samples start a new generation */
+void sample_store_restart(const uip_ipaddr_t *sender);
+
+/* Sequence numbers of the next sample and of the oldest one stored */
+uint16_t sample_store_next(void);
+uint16_t sample_store_oldest(void);
+uint16_t sample_store_count(void);
+
+/* Returns 1 with the sample, or 0 if it is not in the store */
+int sample_store_get(uint16_t seq, struct sample_store_record *r);
+
+/* The first sample from seq on that passes the filter, or
+ * sample_store_next() if there is none. A seq no longer in the store
+ * starts from the oldest sample. */
+uint16_t sample_store_find(uint16_t seq, const struct sample_filter *f);
+
+/* The first of the last n samples that pass the filter */
+uint16_t sample_store_last(uint16_t n, const struct sample_filter *f);
+
+const struct sample_store_stats *sample_store_stats(void);
+
+#endif /* SAMPLE_STORE_H_ */
@@ -41,79 +41,809 @@
 #include "net/ip/uip.h"
 #include "net/ipv6/uip-ds6.h"
 #include "dev/slip.h"
+#if CONTIKI_TARGET_Z1
+#include "dev/uart0.h"
+#else
 #include "dev/uart1.h"
+#endif
+#include "lib/crc16.h"
+#include "sys/ctimer.h"
 #include <string.h>
 
+#include "slip-bridge.h"
+
 #define UIP_IP_BUF        ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 
 #define DEBUG DEBUG_PRINT
 #include "net/ip/uip-debug.h"
 
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+#define SLIP_ESC_XON  0336
+#define SLIP_ESC_XOFF 0337
+
+#define XON  0x11
+#define XOFF 0x13
+
+#ifdef SLIP_BRIDGE_CONF_BAUDRATE
+#define BAUDRATE SLIP_BRIDGE_CONF_BAUDRATE
+#else
+#define BAUDRATE 115200
+#endif
+
+/* Fastest rate the host may ask for */
+#ifdef SLIP_BRIDGE_CONF_BAUDRATE_MAX
+#define BAUDRATE_MAX SLIP_BRIDGE_CONF_BAUDRATE_MAX
+#else
+#define BAUDRATE_MAX 460800
+#endif
+
+/* How long the host has to show up at a new rate */
+#define BAUDRATE_TRIAL (5 * CLOCK_SECOND)
+
+#ifdef SLIP_BRIDGE_CONF_FLOW
+#define FLOW SLIP_BRIDGE_CONF_FLOW
+#else
+#define FLOW SLIP_BRIDGE_FLOW_NONE
+#endif
+
+/* The UART SLIP runs on: how it is set to a rate, where it takes its
+ * receive handler and whether it is still sending. The msp430
+ * slip_arch_init() only installs the handler, so the rate is set here.
+ * Z1 has SLIP on uart0, the other msp430 platforms on uart1. */
+#if CONTIKI_TARGET_Z1
+#define UART_INIT_DEFAULT uart0_init
+#define SET_INPUT_DEFAULT uart0_set_input
+#define TX_ACTIVE_DEFAULT uart0_active
+#else
+#define UART_INIT_DEFAULT uart1_init
+#define SET_INPUT_DEFAULT uart1_set_input
+#define TX_ACTIVE_DEFAULT uart1_active
+#endif
+#ifdef SLIP_BRIDGE_CONF_UART_INIT
+#define UART_INIT SLIP_BRIDGE_CONF_UART_INIT
+#else
+#define UART_INIT UART_INIT_DEFAULT
+#endif
+#ifdef SLIP_BRIDGE_CONF_SET_INPUT
+#define SET_INPUT SLIP_BRIDGE_CONF_SET_INPUT
+#else
+#define SET_INPUT SET_INPUT_DEFAULT
+#endif
+#ifdef SLIP_BRIDGE_CONF_TX_ACTIVE
+#define TX_ACTIVE SLIP_BRIDGE_CONF_TX_ACTIVE
+#else
+#define TX_ACTIVE TX_ACTIVE_DEFAULT
+#endif
+
+#if FLOW == SLIP_BRIDGE_FLOW_RTSCTS
+#if !defined(SLIP_BRIDGE_CONF_CTS) || !defined(SLIP_BRIDGE_CONF_RTS)
+#error "RTS/CTS needs SLIP_BRIDGE_CONF_CTS() and SLIP_BRIDGE_CONF_RTS(on)"
+#endif
+#define CLEAR_TO_SEND() SLIP_BRIDGE_CONF_CTS()
+#elif FLOW == SLIP_BRIDGE_FLOW_XONXOFF
+#define CLEAR_TO_SEND() (!tx_stopped)
+#else
+#define CLEAR_TO_SEND() 1
+#endif
+
+#ifdef SLIP_BRIDGE_CONF_IPHC
+#define IPHC SLIP_BRIDGE_CONF_IPHC
+#else
+#define IPHC 0
+#endif
+
+/* The host is held off from the end of a frame until slip.c has handed
+ * it to us, which it may not do for a frame it threw away */
+#define RX_HOLD_MAX (CLOCK_SECOND / 2)
+
+/* Bytes queued for frames other than debug, which must not be lost. One
+ * stuffed IP packet has to fit. */
+#ifdef SLIP_BRIDGE_CONF_TX_FRAMES
+#define TX_FRAMES SLIP_BRIDGE_CONF_TX_FRAMES
+#else
+#define TX_FRAMES (2 * UIP_BUFSIZE + 8)
+#endif
+
+/* Hosts remembered as sources of packets over SLIP, so that packets from
+ * them with no route are not bounced back */
+#ifdef SLIP_BRIDGE_CONF_SENDERS
+#define SENDERS SLIP_BRIDGE_CONF_SENDERS
+#else
+#define SENDERS 4
+#endif
+
+/* Bytes queued for debug lines, which are dropped when it is full */
+#ifdef SLIP_BRIDGE_CONF_TX_DEBUG
+#define TX_DEBUG SLIP_BRIDGE_CONF_TX_DEBUG
+#else
+#define TX_DEBUG 128
+#endif
+
+/* Bytes handed to the UART per poll of slip_tx_process. No more than the
+ * UART driver's own transmit buffer, so that it does not wait either. */
+#ifdef SLIP_BRIDGE_CONF_TX_BURST
+#define TX_BURST SLIP_BRIDGE_CONF_TX_BURST
+#else
+#define TX_BURST 32
+#endif
+
 void set_prefix_64(uip_ipaddr_t *);
 
-static uip_ipaddr_t last_sender;
+/*
+ * Frames are stuffed into a ring as they are written and each one ends
+ * with SLIP_END; the opening SLIP_END is added when it goes out. Only
+ * bytes before ready, the end of the last whole frame, are sent.
+ */
+struct tx_queue {
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t get;   /* Next byte for the UART */
+  uint16_t ready; /* End of the last whole frame */
+  uint16_t put;   /* End of the frame being written */
+  uint16_t crc;
+  uint8_t open;   /* A frame is being written */
+  uint8_t full;   /* The frame being written did not fit */
+  uint8_t waited; /* The frame being written had to wait for room */
+};
+
+static uint8_t frames_buf[TX_FRAMES];
+static uint8_t debug_buf[TX_DEBUG];
+static struct tx_queue frames_q = { frames_buf, TX_FRAMES };
+static struct tx_queue debug_q = { debug_buf, TX_DEBUG };
+static struct tx_queue *active; /* Queue of the frame on the wire */
+static struct tx_queue *building; /* Of slip_bridge_begin() */
+
+/* Most recent first */
+static uip_ipaddr_t senders[SENDERS];
+static uint8_t senders_count;
+static struct slip_bridge_stats stats;
+
+#if IPHC
+static uint8_t context[8];   /* The prefix shared with the host */
+static uint8_t context_set;
+#endif
+
+static uint32_t baudrate = BAUDRATE;
+static uint32_t baudrate_prev; /* To fall back to */
+static struct ctimer baudrate_timer;
+static uint32_t baudrate_next;   /* Switched to once the answer is out */
+static uint16_t baudrate_mark;   /* Where the answer ends in frames_q */
+static volatile uint8_t baudrate_held; /* It is: nothing more until then */
+
+#if FLOW != SLIP_BRIDGE_FLOW_NONE
+static volatile uint8_t rx_held;   /* A frame is waiting for slip.c */
+static volatile clock_time_t rx_held_since;
+static uint16_t rx_count;          /* Bytes since the last END */
+#endif
+#if FLOW == SLIP_BRIDGE_FLOW_XONXOFF
+static volatile uint8_t tx_stopped; /* The host sent XOFF */
+static uint8_t xoff_sent;
+static uint8_t rx_esc;
+#endif
+
+PROCESS(slip_tx_process, "SLIP transmit");
+/*---------------------------------------------------------------------------*/
+/* Sends one byte, finishing the frame on the wire before starting
+ * another. Frames go before debug lines. Returns 0 when nothing is
+ * ready. */
+static int
+drain_byte(void)
+{
+  uint8_t c;
+
+  if(!CLEAR_TO_SEND() || baudrate_held) {
+    return 0;
+  }
+  if(active == NULL) {
+    if(frames_q.get != frames_q.ready) {
+      active = &frames_q;
+    } else if(debug_q.get != debug_q.ready) {
+      active = &debug_q;
+    } else {
+      return 0;
+    }
+    slip_arch_writeb(SLIP_END);
+  }
+  c = active->buf[active->get];
+  active->get = active->get + 1 == active->size ? 0 : active->get + 1;
+  slip_arch_writeb(c);
+  if(c == SLIP_END) {
+    if(active == &frames_q && baudrate_next != 0 && frames_q.get == baudrate_mark) {
+      baudrate_held = 1;
+    }
+    active = NULL;
+  }
+  return 1;
+}
 /*---------------------------------------------------------------------------*/
 static void
-slip_input_callback(void)
+put(struct tx_queue *q, uint8_t c)
 {
- // PRINTF("SIN: %u\n", uip_len);
-  if(uip_buf[0] == '!') {
-    PRINTF("Got configuration message of type %c\n", uip_buf[1]);
-    uip_len = 0;
-    if(uip_buf[1] == 'P') {
+  uint16_t next = q->put + 1 == q->size ? 0 : q->put + 1;
+
+  if(q->full) {
+    return;
+  }
+  while(next == q->get) {
+    /* Frames wait for the UART, a debug line is dropped instead */
+    if(q == &debug_q || !drain_byte()) {
+      q->full = 1;
+      return;
+    }
+    q->waited = 1;
+  }
+  q->buf[q->put] = c;
+  q->put = next;
+}
+/*---------------------------------------------------------------------------*/
+static void
+writeb(struct tx_queue *q, uint8_t c)
+{
+  q->crc = crc16_add(c, q->crc);
+  if(c == SLIP_END) {
+    put(q, SLIP_ESC);
+    c = SLIP_ESC_END;
+  } else if(c == SLIP_ESC) {
+    put(q, SLIP_ESC);
+    c = SLIP_ESC_ESC;
+#if FLOW == SLIP_BRIDGE_FLOW_XONXOFF
+  } else if(c == XON) {
+    put(q, SLIP_ESC);
+    c = SLIP_ESC_XON;
+  } else if(c == XOFF) {
+    put(q, SLIP_ESC);
+    c = SLIP_ESC_XOFF;
+#endif
+  }
+  put(q, c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+queue_end(struct tx_queue *q)
+{
+  uint16_t crc = q->crc;
+
+  writeb(q, crc >> 8);
+  writeb(q, crc & 0xff);
+  put(q, SLIP_END);
+  q->open = 0;
+  if(q->full) {
+    q->put = q->ready;
+    if(q == &debug_q) {
+      stats.debug_dropped++;
+    } else {
+      stats.tx_dropped++;
+    }
+    return;
+  }
+  q->ready = q->put;
+  stats.tx++;
+  if(q->waited) {
+    stats.tx_waits++;
+  }
+  if(process_is_running(&slip_tx_process)) {
+    process_poll(&slip_tx_process);
+  } else {
+    /* Not started yet, as for output at boot */
+    while(drain_byte());
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+queue_begin(struct tx_queue *q, uint8_t channel)
+{
+  if(q->open) {
+    queue_end(q);
+  }
+  q->open = 1;
+  q->full = 0;
+  q->waited = 0;
+  q->crc = 0;
+  writeb(q, channel);
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_bridge_begin(uint8_t channel)
+{
+  building = channel == SLIP_BRIDGE_DEBUG ? &debug_q : &frames_q;
+  queue_begin(building, channel);
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_bridge_write(const void *data, uint16_t len)
+{
+  const uint8_t *p = data;
+
+  while(len-- > 0) {
+    writeb(building, *p++);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_bridge_end(void)
+{
+  queue_end(building);
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_bridge_send(uint8_t channel, const void *data, uint16_t len)
+{
+  slip_bridge_begin(channel);
+  slip_bridge_write(data, len);
+  slip_bridge_end();
+}
+/*---------------------------------------------------------------------------*/
+#if FLOW != SLIP_BRIDGE_FLOW_NONE
+/* From slip_tx_process and the input callback, not the UART interrupt */
+static void
+rx_release(void)
+{
+  rx_held = 0;
+#if FLOW == SLIP_BRIDGE_FLOW_RTSCTS
+  SLIP_BRIDGE_CONF_RTS(1);
+#else
+  /* Not while a rate switch waits, the host may be at the new one */
+  if(xoff_sent && !baudrate_held) {
+    /* Straight to the UART: the host takes them out wherever they are */
+    slip_arch_writeb(XON);
+    xoff_sent = 0;
+  }
+#endif
+}
+#endif /* FLOW != SLIP_BRIDGE_FLOW_NONE */
+/*---------------------------------------------------------------------------*/
+static void baudrate_switch(void);
+
+PROCESS_THREAD(slip_tx_process, ev, data)
+{
+  static struct etimer et;
+  static uint8_t n;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    if(baudrate_held) {
+      if(TX_ACTIVE()) {
+        /* The answer is still leaving the UART at the old rate */
+        etimer_set(&et, CLOCK_SECOND / 32 + 1);
+        PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_TIMER);
+        continue;
+      }
+      baudrate_switch();
+    }
+#if FLOW == SLIP_BRIDGE_FLOW_XONXOFF
+    if(rx_held && !xoff_sent) {
+      slip_arch_writeb(XOFF);
+      xoff_sent = 1;
+    }
+#endif
+    for(n = 0; n < TX_BURST && drain_byte(); n++);
+    if(n == TX_BURST) {
+      /* Let the rest of the system run before the next burst */
+      process_poll(&slip_tx_process);
+    }
+#if FLOW != SLIP_BRIDGE_FLOW_NONE
+    if(rx_held && clock_time() - rx_held_since > RX_HOLD_MAX) {
+      rx_release();
+    }
+    if(!CLEAR_TO_SEND() || rx_held) {
+      /* Nothing tells us when CTS comes back or a hold has lasted too
+       * long, so look again */
+      etimer_set(&et, CLOCK_SECOND / 32 + 1);
+    }
+#endif
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL || ev == PROCESS_EVENT_TIMER);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Called from the UART interrupt in front of slip.c */
+static int
+input_byte(unsigned char c)
+{
+#if FLOW == SLIP_BRIDGE_FLOW_XONXOFF
+  if(c == XON) {
+    tx_stopped = 0;
+    process_poll(&slip_tx_process);
+    return 0;
+  }
+  if(c == XOFF) {
+    tx_stopped = 1;
+    stats.flow_stops++;
+    return 0;
+  }
+  if(rx_esc) {
+    rx_esc = 0;
+    if(c == SLIP_ESC_XON) {
+      c = XON;
+    } else if(c == SLIP_ESC_XOFF) {
+      c = XOFF;
+    } else {
+      slip_input_byte(SLIP_ESC);
+    }
+  } else if(c == SLIP_ESC) {
+    rx_esc = 1;
+    return 0;
+  }
+#endif
+#if FLOW != SLIP_BRIDGE_FLOW_NONE
+  if(rx_held) {
+    stats.rx_overruns++;
+  }
+  if(c != SLIP_END) {
+    rx_count++;
+  } else if(rx_count > 0) {
+    /* slip.c has room for about one frame: hold the host off until it is
+     * taken */
+    rx_count = 0;
+    rx_held = 1;
+    rx_held_since = clock_time();
+#if FLOW == SLIP_BRIDGE_FLOW_RTSCTS
+    SLIP_BRIDGE_CONF_RTS(0);
+#else
+    process_poll(&slip_tx_process);
+#endif
+  }
+#endif /* FLOW != SLIP_BRIDGE_FLOW_NONE */
+  return slip_input_byte(c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+uart_init(uint32_t rate)
+{
+  UART_INIT(BAUD2UBR(rate));
+  SET_INPUT(input_byte);
+  baudrate = rate;
+}
+/*---------------------------------------------------------------------------*/
+static void
+baudrate_fallback(void *ptr)
+{
+  PRINTF("slip-bridge: nothing at %lu baud, back to %lu\n",
+         (unsigned long)baudrate, (unsigned long)baudrate_prev);
+  uart_init(baudrate_prev);
+}
+/*---------------------------------------------------------------------------*/
+static void
+baudrate_reply(void)
+{
+  char reply[12];
+  uint32_t r = baudrate;
+  uint8_t i = sizeof(reply);
+
+  do {
+    reply[--i] = '0' + r % 10;
+    r /= 10;
+  } while(r > 0);
+  reply[--i] = 'B';
+  reply[--i] = '!';
+  slip_bridge_send(SLIP_BRIDGE_CONTROL, &reply[i], sizeof(reply) - i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+baudrate_set(const uint8_t *digits, uint16_t len)
+{
+  uint32_t rate = 0;
+
+  while(len > 0 && *digits >= '0' && *digits <= '9' && rate <= BAUDRATE_MAX) {
+    rate = rate * 10 + *digits++ - '0';
+    len--;
+  }
+  if(len > 0 || rate < 1200 || rate > BAUDRATE_MAX || baudrate_next != 0) {
+    /* Refused, also while a switch waits: the answer gives the rate
+     * that stays */
+    baudrate_reply();
+    return;
+  }
+
+  baudrate_prev = baudrate;
+  baudrate = rate;
+  baudrate_reply();
+  /* The answer and the frames before it go at the old rate, as fast as
+   * the host lets them; slip_tx_process switches once the UART has sent
+   * its last byte. Nothing is sent in between. */
+  baudrate_next = rate;
+  baudrate_mark = frames_q.ready;
+  if(frames_q.get == baudrate_mark && active != &frames_q) {
+    /* Already gone, or dropped for want of room */
+    baudrate_held = 1;
+  }
+  process_poll(&slip_tx_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+baudrate_switch(void)
+{
+  uart_init(baudrate_next);
+  baudrate_next = 0;
+  baudrate_held = 0;
+  ctimer_set(&baudrate_timer, BAUDRATE_TRIAL, baudrate_fallback, NULL);
+#if FLOW == SLIP_BRIDGE_FLOW_XONXOFF
+  if(xoff_sent && !rx_held) {
+    /* rx_release() held it back */
+    slip_arch_writeb(XON);
+    xoff_sent = 0;
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+slip_bridge_baudrate(void)
+{
+  return baudrate;
+}
+/*---------------------------------------------------------------------------*/
+const struct slip_bridge_stats *
+slip_bridge_stats(void)
+{
+  return &stats;
+}
+#if IPHC
+/*---------------------------------------------------------------------------*/
+static void
+context_reply(void)
+{
+  uint8_t reply[10];
+
+  reply[0] = '!';
+  reply[1] = 'C';
+  memcpy(&reply[2], context, 8);
+  slip_bridge_send(SLIP_BRIDGE_CONTROL, reply, context_set ? 10 : 2);
+}
+/*---------------------------------------------------------------------------*/
+/* Appends what is sent of address a to out and returns its mode */
+static uint8_t
+compress_addr(const uint8_t *a, uint8_t *out, uint8_t *len)
+{
+  static const uint8_t linklocal[8] = { 0xfe, 0x80 };
+  static const uint8_t short_iid[6] = { 0, 0, 0, 0xff, 0xfe, 0 };
+  uint8_t mode;
+
+  if(memcmp(a, linklocal, 8) == 0) {
+    mode = 0;
+  } else if(context_set && memcmp(a, context, 8) == 0) {
+    mode = 4;
+  } else {
+    memcpy(&out[*len], a, 16);
+    *len += 16;
+    return 0;
+  }
+  if(memcmp(&a[8], short_iid, 6) == 0) {
+    memcpy(&out[*len], &a[14], 2);
+    *len += 2;
+    return mode | 2;
+  }
+  memcpy(&out[*len], &a[8], 8);
+  *len += 8;
+  return mode | 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Builds the compressed header of the packet in uip_buf in hdr. Returns
+ * its length and in *skip how much of the packet it stands for, or 0 to
+ * send the packet as it is. */
+static uint8_t
+compress(uint8_t *hdr, uint8_t *skip)
+{
+  const uint8_t *ip = &uip_buf[UIP_LLH_LEN];
+  uint8_t len = 2;
+
+  if(uip_len < UIP_IPH_LEN || (ip[0] >> 4) != 6) {
+    return 0;
+  }
+  hdr[0] = 0;
+  if((ip[0] & 0x0f) == 0 && ip[1] == 0 && ip[2] == 0 && ip[3] == 0) {
+    hdr[0] |= 0x80;
+  } else {
+    memcpy(&hdr[len], ip, 4);
+    len += 4;
+  }
+  *skip = UIP_IPH_LEN;
+  /* The UDP length has to be the rest of the packet to be left out */
+  if(ip[6] == UIP_PROTO_UDP && uip_len >= UIP_IPH_LEN + UIP_UDPH_LEN &&
+     ((ip[44] << 8) | ip[45]) == uip_len - UIP_IPH_LEN) {
+    hdr[0] |= 0x40;
+  } else {
+    hdr[len++] = ip[6];
+  }
+  switch(ip[7]) {
+  case 1:   hdr[0] |= 0x10; break;
+  case 64:  hdr[0] |= 0x20; break;
+  case 255: hdr[0] |= 0x30; break;
+  default:  hdr[len++] = ip[7]; break;
+  }
+  hdr[1] = compress_addr(&ip[8], hdr, &len) << 4;
+  hdr[1] |= compress_addr(&ip[24], hdr, &len);
+  if(hdr[0] & 0x40) {
+    memcpy(&hdr[len], &ip[40], 4);       /* Ports */
+    memcpy(&hdr[len + 4], &ip[46], 2);   /* Checksum */
+    len += 6;
+    *skip += UIP_UDPH_LEN;
+  }
+  return len;
+}
+#endif /* IPHC */
+/*---------------------------------------------------------------------------*/
+static void
+control_input(uint8_t *msg, uint16_t len)
+{
+  static const char hexchar[] = "0123456789abcdef";
+  uint8_t reply[18];
+  int j;
+
+  if(len < 2) {
+    return;
+  }
+  if(msg[0] == '!') {
+    PRINTF("Got configuration message of type %c\n", msg[1]);
+    if(msg[1] == 'P' && len >= 10) {
       uip_ipaddr_t prefix;
       /* Here we set a prefix !!! */
       memset(&prefix, 0, 16);
-      memcpy(&prefix, &uip_buf[2], 8);
+      memcpy(&prefix, &msg[2], 8);
       PRINTF("Setting prefix ");
       PRINT6ADDR(&prefix);
       PRINTF("\n");
       set_prefix_64(&prefix);
+#if IPHC
+      memcpy(context, &msg[2], 8);
+      context_set = 1;
+      context_reply();
+#endif
+    } else if(msg[1] == 'B') {
+      baudrate_set(&msg[2], len - 2);
     }
-  } else if (uip_buf[0] == '?') {
-    PRINTF("Got request message of type %c\n", uip_buf[1]);
-    if(uip_buf[1] == 'M') {
-      char* hexchar = "0123456789abcdef";
-      int j;
-      /* this is just a test so far... just to see if it works */
-      uip_buf[0] = '!';
+  } else if(msg[0] == '?') {
+    PRINTF("Got request message of type %c\n", msg[1]);
+    if(msg[1] == 'M') {
+      reply[0] = '!';
+      reply[1] = 'M';
       for(j = 0; j < 8; j++) {
-        uip_buf[2 + j * 2] = hexchar[uip_lladdr.addr[j] >> 4];
-        uip_buf[3 + j * 2] = hexchar[uip_lladdr.addr[j] & 15];
+        reply[2 + j * 2] = hexchar[uip_lladdr.addr[j] >> 4];
+        reply[3 + j * 2] = hexchar[uip_lladdr.addr[j] & 15];
       }
-      uip_len = 18;
-      slip_send();
-      
+      slip_bridge_send(SLIP_BRIDGE_CONTROL, reply, sizeof(reply));
+    } else if(msg[1] == 'B') {
+      baudrate_reply();
+#if IPHC
+    } else if(msg[1] == 'C') {
+      context_reply();
+#endif
     }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+sender_find(const uip_ipaddr_t *addr)
+{
+  uint8_t i;
+
+  for(i = 0; i < senders_count; i++) {
+    if(uip_ipaddr_cmp(&senders[i], addr)) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Moves addr to the front, pushing out the least recent sender when the
+ * cache is full */
+static void
+sender_seen(const uip_ipaddr_t *addr)
+{
+  int i = sender_find(addr);
+
+  if(i == 0) {
+    return;
+  }
+  if(i < 0) {
+    i = senders_count < SENDERS ? senders_count++ : SENDERS - 1;
+  }
+  memmove(&senders[1], &senders[0], i * sizeof(uip_ipaddr_t));
+  uip_ipaddr_copy(&senders[0], addr);
+}
+/*---------------------------------------------------------------------------*/
+/* slip.c has undone the byte stuffing: uip_buf holds channel, payload and
+ * CRC. Only IP is left in uip_buf for tcpip_input(). */
+static void
+slip_input_callback(void)
+{
+  uint8_t *frame = &uip_buf[UIP_LLH_LEN];
+  uint16_t crc = 0, i;
+  uint8_t channel;
+
+#if FLOW != SLIP_BRIDGE_FLOW_NONE
+  /* slip.c has room again */
+  rx_release();
+#endif
+  if(uip_len < 3) {
+    stats.runts++;
     uip_len = 0;
+    return;
+  }
+  for(i = 0; i < uip_len - 2; i++) {
+    crc = crc16_add(frame[i], crc);
+  }
+  if(crc != ((frame[uip_len - 2] << 8) | frame[uip_len - 1])) {
+    stats.bad_crc++;
+    uip_len = 0;
+    return;
+  }
+  stats.rx++;
+  /* The host is there at the new rate */
+  ctimer_stop(&baudrate_timer);
+
+  channel = frame[0];
+  uip_len -= 3;
+  memmove(frame, frame + 1, uip_len);
+  switch(channel) {
+  case SLIP_BRIDGE_IP:
+    /* Save the last sender received over SLIP to avoid bouncing the
+       packet back if no route is found */
+    sender_seen(&UIP_IP_BUF->srcipaddr);
+    return;
+  case SLIP_BRIDGE_CONTROL:
+    control_input(frame, uip_len);
+    break;
+  case SLIP_BRIDGE_DEBUG:
+  case SLIP_BRIDGE_TELEMETRY:
+  case SLIP_BRIDGE_IPHC:
+    /* Nothing for us from the host on these */
+    break;
+  default:
+    stats.bad_channel++;
+    break;
   }
-  /* Save the last sender received over SLIP to avoid bouncing the
-     packet back if no route is found */
-  uip_ipaddr_copy(&last_sender, &UIP_IP_BUF->srcipaddr);
+  uip_len = 0;
 }
 /*---------------------------------------------------------------------------*/
 static void
 init(void)
 {
-  slip_arch_init(BAUD2UBR(115200));
+  uart_init(BAUDRATE);
+#if FLOW == SLIP_BRIDGE_FLOW_RTSCTS
+  SLIP_BRIDGE_CONF_RTS(1);
+#endif
   process_start(&slip_process, NULL);
   slip_set_input_callback(slip_input_callback);
+  process_start(&slip_tx_process, NULL);
 }
 /*---------------------------------------------------------------------------*/
 static int
 output(void)
 {
-  if(uip_ipaddr_cmp(&last_sender, &UIP_IP_BUF->srcipaddr)) {
+  if(sender_find(&UIP_IP_BUF->srcipaddr) >= 0) {
     /* Do not bounce packets back over SLIP if the packet was received
        over SLIP */
+    stats.bounces++;
     PRINTF("slip-bridge: Destination off-link but no route src=");
     PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
     PRINTF(" dst=");
     PRINT6ADDR(&UIP_IP_BUF->destipaddr);
     PRINTF("\n");
   } else {
- //   PRINTF("SUT: %u\n", uip_len);
-    slip_send();
+    stats.forwarded++;
+#if IPHC
+    /* At most flags, tc+flow, next header, hop limit, two addresses and
+     * the UDP ports and checksum */
+    uint8_t hdr[2 + 4 + 1 + 1 + 16 + 16 + 6];
+    uint8_t len, skip;
+
+    len = compress(hdr, &skip);
+    if(len > 0) {
+      slip_bridge_begin(SLIP_BRIDGE_IPHC);
+      slip_bridge_write(hdr, len);
+      slip_bridge_write(&uip_buf[UIP_LLH_LEN + skip], uip_len - skip);
+      slip_bridge_end();
+      stats.compressed++;
+      stats.saved += skip - len;
+      return 0;
+    }
+#endif
+    slip_bridge_send(SLIP_BRIDGE_IP, &uip_buf[UIP_LLH_LEN], uip_len);
   }
   return 0;
 }
@@ -124,26 +854,20 @@ output(void)
 int
 putchar(int c)
 {
-#define SLIP_END     0300
-  static char debug_frame = 0;
+  uint8_t b = c;
 
-  if(!debug_frame) {            /* Start of debug output */
-    slip_arch_writeb(SLIP_END);
-    slip_arch_writeb('\r');     /* Type debug line == '\r' */
-    debug_frame = 1;
+  if(!debug_q.open) {  /* Start of debug output */
+    queue_begin(&debug_q, SLIP_BRIDGE_DEBUG);
   }
 
-  /* Need to also print '\n' because for example COOJA will not show
-     any output before line end */
-  slip_arch_writeb((char)c);
+  writeb(&debug_q, b);
 
   /*
    * Line buffered output, a newline marks the end of debug output and
-   * implicitly flushes debug output.
+   * queues it. A line that does not fit is dropped whole.
    */
   if(c == '\n') {
-    slip_arch_writeb(SLIP_END);
-    debug_frame = 0;
+    queue_end(&debug_q);
   }
   return c;
 }
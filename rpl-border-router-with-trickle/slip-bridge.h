@@ -0,0 +1,97 @@
+/**
+ * \file
+ *         Framed protocol on the SLIP link to the host
+ *
+ *         Every SLIP frame carries a channel byte, the payload and a
+ *         CRC-16 (lib/crc16.h, over channel and payload, high byte first):
+ *
+ *           END channel payload crc-hi crc-lo END
+ *
+ *         so that IP, debug output, control messages and telemetry share
+ *         the link and a corrupted frame is dropped and counted instead of
+ *         being taken for something else. tools/slipmux.c is the host end.
+ */
+
+#ifndef SLIP_BRIDGE_H_
+#define SLIP_BRIDGE_H_
+
+#include "contiki.h"
+
+#define SLIP_BRIDGE_IP        0 /* IPv6 packets */
+#define SLIP_BRIDGE_DEBUG     1 /* Console output, a line per frame */
+#define SLIP_BRIDGE_CONTROL   2 /* '!' and '?' messages, as with tunslip6 */
+#define SLIP_BRIDGE_TELEMETRY 3 /* Sample batches, after the sender address */
+#define SLIP_BRIDGE_IPHC      4 /* IPv6 packets with compressed headers */
+#define SLIP_BRIDGE_CHANNELS  5
+
+/*
+ * With SLIP_BRIDGE_CONF_IPHC the router sends IPv6 packets to the host on
+ * the IPHC channel, with their headers compressed much like 6LoWPAN IPHC:
+ *
+ *   flags0 flags1 [tc+flow 4] [next header] [hop limit] src dst [udp] data
+ *
+ *   flags0  0x80  traffic class and flow label are zero, not sent
+ *           0x40  UDP: next header not sent, UDP header sent as ports and
+ *                 checksum, its length taken from the frame
+ *           0x30  hop limit: 0 sent, 1 = 1, 2 = 64, 3 = 255
+ *   flags1  0x70  source, 0x07 destination, each:
+ *                 0x4   prefix from the context, else fe80::/64
+ *                 0x3   0 = all 16 bytes sent (fe80 only),
+ *                       1 = the 8-byte interface identifier sent,
+ *                       2 = 16 bits sent for ::ff:fe00:XXXX
+ *
+ * The context is the /64 prefix the host gave with "!P". The router sends
+ * it as "!C<prefix>" once set and when asked with "?C"; until then only
+ * link-local addresses are compressed. The payload length is never sent.
+ */
+
+/* Flow control on the serial line, for SLIP_BRIDGE_CONF_FLOW. With
+ * RTS/CTS the platform defines SLIP_BRIDGE_CONF_CTS(), true while the
+ * host can take data, and SLIP_BRIDGE_CONF_RTS(on) to let it send. With
+ * XON/XOFF those two bytes are escaped like END and ESC in both
+ * directions, as ESC 0336 and ESC 0337. */
+#define SLIP_BRIDGE_FLOW_NONE    0
+#define SLIP_BRIDGE_FLOW_XONXOFF 1
+#define SLIP_BRIDGE_FLOW_RTSCTS  2
+
+struct slip_bridge_stats
+{
+  uint32_t rx;          /* Frames received and accepted */
+  uint32_t tx;          /* Frames sent */
+  uint32_t bad_crc;
+  uint32_t bad_channel;
+  uint32_t runts;       /* Too short to hold a channel and a CRC */
+  uint32_t debug_dropped; /* Debug lines with no room in their queue */
+  uint32_t tx_dropped;  /* Other frames larger than their queue */
+  uint32_t tx_waits;    /* Frames that waited for the UART to make room */
+  uint32_t flow_stops;  /* Times the host stopped our output */
+  uint32_t rx_overruns; /* Bytes the host sent after being held off. A few
+                         * per hold are in flight; more mean it ignores
+                         * flow control. */
+  uint32_t compressed;  /* Packets sent on the IPHC channel */
+  uint32_t saved;       /* Header bytes they did not send */
+  uint32_t forwarded;   /* Packets with no route sent to the host */
+  uint32_t bounces;     /* Such packets not sent back to the host they
+                         * came from */
+};
+
+/* A frame is queued as it is built: begin, any number of writes, end.
+ * slip_tx_process sends the queues a burst at a time, so the caller does
+ * not wait for the UART. IP, control and telemetry frames share a queue
+ * that goes first; debug lines have their own and are dropped when it is
+ * full. */
+void slip_bridge_begin(uint8_t channel);
+void slip_bridge_write(const void *data, uint16_t len);
+void slip_bridge_end(void);
+
+void slip_bridge_send(uint8_t channel, const void *data, uint16_t len);
+
+const struct slip_bridge_stats *slip_bridge_stats(void);
+
+/* The rate starts at SLIP_BRIDGE_CONF_BAUDRATE. The host asks for another
+ * with the control message "!B<rate>" and reads the current one with
+ * "?B"; both are answered with "!B<rate>", sent at the old rate. The
+ * router falls back when nothing valid arrives at the new rate. */
+uint32_t slip_bridge_baudrate(void);
+
+#endif /* SLIP_BRIDGE_H_ */
@@ -0,0 +1,403 @@
+#!/usr/bin/env python3
+"""Drive the Cooja scenarios of the border router and check their outcome.
+
+Every scenario derives from project.csc: the border router is mote 1,
+the sensor nodes motes 2-4, and its serial line is on port 60001. Start
+the scenario in Cooja, bring up the tunnel with
+
+    make connect-router-cooja
+
+and run this script with the matching subcommand. The ScriptRunner of
+the scenario paces the simulation to real time and writes every line
+the motes print to <scenario>.log, in the directory Cooja was started
+from, as "<ms>\\t<mote id>\\t<line>".
+
+    bytes   trickle-bytes.csc: issue commands, let the network settle,
+            and report the ADV/REQ/DATA bytes sent against what
+            advertising the full table would have taken
+    reboot  root-reboot.csc: issue a command, reboot the border router,
+            check that it restored its config version and last command
+            from CFS, and that the nodes adopt its next command
+    poll    status-poll.csc: once the network has settled, poll the
+            status pages and check that the border router's Trickle
+            timer keeps backing off
+    pipeline  any of them: send two requests in one write on a
+            persistent connection, then one while a response is still
+            being sent, and check that each gets its whole response in
+            order
+
+The script exits with 0 when the scenario passed and 1 when it did not.
+"""
+
+import argparse
+import json
+import os
+import re
+import socket
+import sys
+import time
+import urllib.error
+import urllib.request
+
+ROUTER = "[fd00::c30c:0:0:1]"  # Mote 1 under the default PREFIX
+
+MSG_ADV, MSG_REQ, MSG_DATA = 0, 1, 2
+VERSION_CIRCULAR = 0x7fff
+BYTES_RE = re.compile(r"Trickle bytes: type (\d+) len (\d+) full (\d+)")
+
+
+class Router:
+    def __init__(self, host, timeout):
+        self.host = host
+        self.timeout = timeout
+
+    def get(self, path):
+        url = "http://%s/%s" % (self.host, path)
+        with urllib.request.urlopen(url, timeout=self.timeout) as r:
+            return r.read().decode("ascii", "replace")
+
+    def status(self):
+        return json.loads(self.get("status.json"))
+
+    def wait_up(self, deadline):
+        """Wait until the web server answers, e.g. after a reboot."""
+        while True:
+            try:
+                return self.status()
+            except (OSError, ValueError, urllib.error.URLError):
+                if time.time() > deadline:
+                    raise
+                time.sleep(2)
+
+    def command(self, query):
+        """Issue /set?<query>, retrying while the router still learns the
+        network's config version. Returns the page."""
+        while True:
+            page = self.get("set?" + query)
+            if "try again" not in page:
+                break
+            time.sleep(2)
+        if "Invalid command" in page:
+            raise RuntimeError("Command refused: set?" + query)
+        return page
+
+    def wait_settled(self, deadline):
+        """Wait until every node has acked the current version."""
+        while True:
+            s = self.status()
+            if s["dissem"]["pending"] == 0:
+                return s
+            if time.time() > deadline:
+                raise RuntimeError("%u nodes still pending" % s["dissem"]["pending"])
+            time.sleep(2)
+
+
+class Log:
+    """The lines the scenario's ScriptRunner writes, read as they come."""
+
+    def __init__(self, path):
+        self.path = path
+        self.lines = []
+        self.offset = 0
+
+    def read(self):
+        try:
+            with open(self.path, "rb") as f:
+                f.seek(self.offset)
+                data = f.read()
+        except FileNotFoundError:
+            return
+        # Only complete lines; the rest is read again next time
+        end = data.rfind(b"\n") + 1
+        self.offset += end
+        for raw in data[:end].splitlines():
+            parts = raw.decode("latin-1").split("\t", 2)
+            if len(parts) == 3:
+                self.lines.append((int(parts[0]), int(parts[1]), parts[2]))
+
+    def find(self, pattern, mote=None, after=0):
+        """Lines at or after the time `after` (ms) matching pattern. The
+        border router's lines come inside SLIP frames, so match anywhere."""
+        self.read()
+        r = re.compile(pattern)
+        found = []
+        for t, m, line in self.lines:
+            if t < after or (mote is not None and m != mote):
+                continue
+            match = r.search(line)
+            if match:
+                found.append((t, m, match))
+        return found
+
+    def now(self):
+        self.read()
+        return self.lines[-1][0] if self.lines else 0
+
+
+def version_next(v):
+    """config_version_next()"""
+    return 0 if v == VERSION_CIRCULAR else (v + 1) & 0xffff
+
+
+def nodes_acked(status, version):
+    return sum(1 for n in status["nodes"] if n["acked"] == version)
+
+
+def wait_adopted(router, version, nodes, deadline):
+    """Wait until `nodes` nodes have acked `version`."""
+    while True:
+        s = router.status()
+        if s["dissem"]["version"] == version and nodes_acked(s, version) >= nodes:
+            return s
+        if time.time() > deadline:
+            raise RuntimeError("%u of %u nodes acked version 0x%04x"
+                               % (nodes_acked(s, version), nodes, version))
+        time.sleep(2)
+
+
+def wait_log(log, pattern, mote, after, deadline):
+    while True:
+        found = log.find(pattern, mote, after)
+        if found:
+            return found[0]
+        if time.time() > deadline:
+            raise RuntimeError("No %r in %s" % (pattern, log.path))
+        time.sleep(1)
+
+
+def bytes_report(log, after):
+    """Sum the logged messages per type from `after` on."""
+    sent = {MSG_ADV: [0, 0], MSG_REQ: [0, 0], MSG_DATA: [0, 0]}
+    full = 0
+    for _, _, m in log.find(BYTES_RE.pattern, after=after):
+        kind, length, table = (int(g) for g in m.groups())
+        if kind in sent:
+            sent[kind][0] += 1
+            sent[kind][1] += length
+        if kind == MSG_ADV:
+            full += table
+    digest = sum(b for _, b in sent.values())
+
+    print("UDP payload bytes sent by all motes:")
+    print("  %-5s %8s %8s" % ("", "messages", "bytes"))
+    for name, kind in (("ADV", MSG_ADV), ("REQ", MSG_REQ), ("DATA", MSG_DATA)):
+        print("  %-5s %8u %8u" % (name, sent[kind][0], sent[kind][1]))
+    print("  digest scheme:     %8u bytes" % digest)
+    print("  full-table scheme: %8u bytes (%u advertisements of the whole table)"
+          % (full, sent[MSG_ADV][0]))
+    if full:
+        print("  ratio:             %8.2f" % (digest / full))
+    return sent[MSG_ADV][0] > 0
+
+
+def run_bytes(args, router, log):
+    deadline = time.time() + args.timeout
+    router.wait_up(deadline)
+    start = log.now()
+    # One entry of every selector type, then a change of two of them
+    queries = ["p=60&n=2", "p=90&i=3-4", "p=120&b=2-7", "p=150&r=256-512",
+               "p=75&n=2", "p=95&i=3-4"]
+    for q in queries[:args.commands]:
+        print("set?" + q)
+        router.command(q)
+        router.wait_settled(deadline)
+    print("Settling for %us" % args.settle)
+    time.sleep(args.settle)
+    return bytes_report(log, start)
+
+
+def run_reboot(args, router, log):
+    deadline = time.time() + args.timeout
+    router.wait_up(deadline)
+
+    router.command("p=90&n=0")
+    before = router.status()["dissem"]["version"]
+    wait_adopted(router, before, args.nodes, deadline)
+    print("Version before the reboot: 0x%04x" % before)
+
+    # The scenario's script reboots mote 1 when this file appears
+    open(os.path.join(os.path.dirname(log.path) or ".", "root-reboot.request"), "w").close()
+    rebooted, _, _ = wait_log(log, r"^# reboot mote 1", 0, 0, deadline)
+
+    _, _, m = wait_log(log, r"Restored config version 0x([0-9a-f]{4})", 1, rebooted, deadline)
+    restored = int(m.group(1), 16)
+    _, _, m = wait_log(log, r"Restored command: selector (\d+) \[(\d+), (\d+)\] => interval (\d+)",
+                       1, rebooted, deadline)
+    print("Restored version 0x%04x, interval %s" % (restored, m.group(4)))
+    ok = True
+    if restored != before:
+        print("FAIL: restored version 0x%04x, expected 0x%04x" % (restored, before))
+        ok = False
+    if m.group(2) != "0" or m.group(4) != "90":
+        print("FAIL: restored the wrong command")
+        ok = False
+
+    # The restored counter lets the next command out at once, and the
+    # nodes' lollipop comparison must take it over what they hold
+    router.wait_up(deadline)
+    router.command("p=120&n=0")
+    after = router.status()["dissem"]["version"]
+    if after != version_next(before):
+        print("FAIL: version 0x%04x after the reboot, expected 0x%04x"
+              % (after, version_next(before)))
+        return False
+    wait_adopted(router, after, args.nodes, deadline)
+    print("Every node adopted version 0x%04x" % after)
+    return ok
+
+
+def run_poll(args, router, log):
+    deadline = time.time() + args.timeout
+    router.wait_up(deadline)
+
+    router.command("p=60&n=0")
+    version = router.status()["dissem"]["version"]
+    wait_adopted(router, version, args.nodes, deadline)
+
+    # Trickle reaches Imax about two Imax intervals after the last reset
+    trickle = router.status()["dissem"]["trickle"]
+    interval = trickle["imin"] * (1 << trickle["imax"]) / 1000.0
+    print("Version 0x%04x settled, waiting %.0fs for Imax" % (version, 2 * interval))
+    time.sleep(2 * interval)
+
+    first = last = router.status()["dissem"]
+    polls = 0
+    end = time.time() + args.window
+    while time.time() < end:
+        router.get("")
+        last = router.status()["dissem"]
+        polls += 2
+        time.sleep(args.every)
+
+    tx = last["stats"]["tx"] - first["stats"]["tx"]
+    resets = last["stats"]["resets"] - first["stats"]["resets"]
+    # Without an inconsistency Trickle sends at most once per interval
+    allowed = int(args.window // interval) + 1
+    print("%u polls in %us: %u advertisements (at most %u), %u resets"
+          % (polls, args.window, tx, allowed, resets))
+    ok = True
+    if last["version"] != version:
+        print("FAIL: the version moved to 0x%04x" % last["version"])
+        ok = False
+    if resets != 0:
+        print("FAIL: polling reset the Trickle timer")
+        ok = False
+    if tx > allowed:
+        print("FAIL: the Trickle tx counter rose faster than Imax allows")
+        ok = False
+    return ok
+
+
+def read_response(f):
+    """Read one response from the file f. Returns its status code, headers
+    and body, with the chunks of a chunked body joined."""
+    status = f.readline().decode("latin-1").split()
+    if len(status) < 2:
+        raise RuntimeError("Connection closed before a response")
+    headers = {}
+    while True:
+        line = f.readline().decode("latin-1")
+        if line.strip() == "":
+            break
+        name, _, value = line.partition(":")
+        headers[name.strip().lower()] = value.strip()
+    if headers.get("transfer-encoding") != "chunked":
+        return int(status[1]), headers, f.read()
+    body = b""
+    while True:
+        size = int(f.readline().split(b";")[0], 16)
+        if size == 0:
+            f.readline()
+            return int(status[1]), headers, body
+        body += f.read(size)
+        f.readline()
+
+
+def check_response(response, kind):
+    """kind is "html" or "json"; the body must be a whole page of it."""
+    code, headers, body = response
+    if code != 200:
+        print("FAIL: status %u" % code)
+        return False
+    if kind not in headers.get("content-type", ""):
+        print("FAIL: %s where %s was expected" % (headers.get("content-type"), kind))
+        return False
+    text = body.decode("ascii", "replace")
+    if kind == "json":
+        try:
+            json.loads(text)
+        except ValueError:
+            print("FAIL: the JSON response does not parse")
+            return False
+    elif not text.rstrip().endswith("</html>"):
+        print("FAIL: the page is cut short")
+        return False
+    return True
+
+
+def run_pipeline(args, router, log):
+    deadline = time.time() + args.timeout
+    router.wait_up(deadline)
+    host = router.host.strip("[]")
+    # Short enough for both to fit the 60-byte receive window of the router
+    page = b"GET / HTTP/1.1\r\n\r\n"
+    status = b"GET /status.json HTTP/1.1\r\n\r\n"
+    ok = True
+
+    with socket.create_connection((host, 80), timeout=router.timeout) as c:
+        c.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        f = c.makefile("rb")
+        print("Two requests in one write")
+        c.sendall(page + status)
+        ok &= check_response(read_response(f), "html")
+        ok &= check_response(read_response(f), "json")
+
+        print("A request while a response is being sent")
+        c.sendall(status)
+        c.recv(1, socket.MSG_PEEK)  # The response has started
+        c.sendall(page)
+        ok &= check_response(read_response(f), "json")
+        ok &= check_response(read_response(f), "html")
+    return ok
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--router", default=ROUTER, help="border router host, default " + ROUTER)
+    p.add_argument("--log", help="log written by the scenario, default <scenario>.log")
+    p.add_argument("--timeout", type=int, default=900, help="seconds the scenario may take")
+    sub = p.add_subparsers(dest="scenario", required=True)
+
+    b = sub.add_parser("bytes", help="trickle-bytes.csc")
+    b.add_argument("--commands", type=int, default=6, help="commands to issue, at most 6")
+    b.add_argument("--settle", type=int, default=300, help="seconds to run after the last one")
+    b.set_defaults(run=run_bytes, csc="trickle-bytes")
+
+    r = sub.add_parser("reboot", help="root-reboot.csc")
+    r.add_argument("--nodes", type=int, default=3, help="sensor nodes in the scenario")
+    r.set_defaults(run=run_reboot, csc="root-reboot")
+
+    q = sub.add_parser("poll", help="status-poll.csc")
+    q.add_argument("--nodes", type=int, default=3, help="sensor nodes in the scenario")
+    q.add_argument("--every", type=int, default=5, help="seconds between polls")
+    q.add_argument("--window", type=int, default=300, help="seconds to poll for")
+    q.set_defaults(run=run_poll, csc="status-poll")
+
+    h = sub.add_parser("pipeline", help="any scenario")
+    h.set_defaults(run=run_pipeline, csc="status-poll")
+
+    args = p.parse_args()
+    router = Router(args.router, 10)
+    log = Log(args.log or args.csc + ".log")
+    try:
+        ok = args.run(args, router, log)
+    except (RuntimeError, OSError, urllib.error.URLError) as e:
+        print("FAIL: %s" % e)
+        ok = False
+    print("PASS" if ok else "FAIL")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,637 @@
+/*
+ * Host end of the framed SLIP protocol of slip-bridge.c.
+ *
+ * Reads the border router's serial line, or a Cooja serial socket, and
+ * splits it by channel:
+ *
+ *   IP and control  passed on as plain SLIP to tunslip6, started with
+ *                   -a 127.0.0.1 -p <listen port>, whose frames go back
+ *   IPHC            IPv6 with compressed headers, expanded for tunslip6
+ *   debug           written to stdout
+ *   telemetry       written to stdout as "T <sender> <hex payload>" lines
+ *
+ * Frames with a bad CRC or channel are dropped and counted on stderr.
+ *
+ * -B is the rate the router starts at. -b asks it for another once the
+ * line is open, with the control message "!B<rate>". -x uses XON/XOFF,
+ * escaped in the frames as ESC 0336 and ESC 0337, and -r RTS/CTS; the
+ * router must be built with the same SLIP_BRIDGE_CONF_FLOW.
+ *
+ * Usage: slipmux [-s device] [-B baud] [-b baud] [-x | -r]
+ *                [-a host -p port] [-L listen port]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+#define SLIP_ESC_XON  0336
+#define SLIP_ESC_XOFF 0337
+
+#define XON  0x11
+#define XOFF 0x13
+
+/* As in slip-bridge.h */
+#define CHANNEL_IP        0
+#define CHANNEL_DEBUG     1
+#define CHANNEL_CONTROL   2
+#define CHANNEL_TELEMETRY 3
+#define CHANNEL_IPHC      4
+
+#define FRAME_MAX 2048
+
+struct slip_rx {
+  uint8_t buf[FRAME_MAX];
+  int len;
+  int esc;
+  int overflow;
+};
+
+static int router = -1;   /* Serial line or Cooja socket */
+static int listener = -1;
+static int tunslip = -1;  /* The connected tunslip6, if any */
+static unsigned long bad_crc, bad_channel, runts, overflows, no_tunslip, bad_iphc;
+static uint8_t context[8]; /* The router's prefix, for IPHC */
+static int context_set;
+static int xonxoff;
+static int baud_wanted;   /* Asked of the router, not answered yet */
+
+/*---------------------------------------------------------------------------*/
+/* lib/crc16.c of Contiki */
+static uint16_t
+crc16_add(uint8_t b, uint16_t acc)
+{
+  acc ^= b;
+  acc = (uint16_t)((acc >> 8) | (acc << 8));
+  acc ^= (uint16_t)((acc & 0xff00) << 4);
+  acc ^= (acc >> 8) >> 4;
+  acc ^= (acc & 0xff00) >> 5;
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_all(int fd, const uint8_t *buf, size_t len)
+{
+  ssize_t n;
+
+  while(len > 0) {
+    n = write(fd, buf, len);
+    if(n < 0 && errno == EINTR) {
+      continue;
+    }
+    if(n < 0) {
+      perror("slipmux: write");
+      exit(1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Only the router knows the escapes for XON and XOFF */
+static size_t
+stuff(uint8_t *out, uint8_t c, int flow)
+{
+  if(c == SLIP_END) {
+    out[0] = SLIP_ESC;
+    out[1] = SLIP_ESC_END;
+    return 2;
+  }
+  if(c == SLIP_ESC) {
+    out[0] = SLIP_ESC;
+    out[1] = SLIP_ESC_ESC;
+    return 2;
+  }
+  if(flow && (c == XON || c == XOFF)) {
+    out[0] = SLIP_ESC;
+    out[1] = c == XON ? SLIP_ESC_XON : SLIP_ESC_XOFF;
+    return 2;
+  }
+  out[0] = c;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* channel < 0 writes plain SLIP, for tunslip6 */
+static void
+send_frame(int fd, int channel, const uint8_t *data, int len)
+{
+  static uint8_t out[2 * FRAME_MAX + 8];
+  size_t n = 0;
+  uint16_t crc = 0;
+  int flow = xonxoff && channel >= 0;
+  int i;
+
+  out[n++] = SLIP_END;
+  if(channel >= 0) {
+    crc = crc16_add(channel, crc);
+    n += stuff(&out[n], channel, flow);
+  }
+  for(i = 0; i < len; i++) {
+    crc = crc16_add(data[i], crc);
+    n += stuff(&out[n], data[i], flow);
+  }
+  if(channel >= 0) {
+    n += stuff(&out[n], crc >> 8, flow);
+    n += stuff(&out[n], crc & 0xff, flow);
+  }
+  out[n++] = SLIP_END;
+  write_all(fd, out, n);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns 1 when rx holds a whole frame */
+static int
+slip_rx_byte(struct slip_rx *rx, uint8_t c)
+{
+  if(c == SLIP_END) {
+    if(rx->overflow) {
+      overflows++;
+      rx->overflow = 0;
+      rx->len = 0;
+      return 0;
+    }
+    return rx->len > 0;
+  }
+  if(rx->esc) {
+    rx->esc = 0;
+    if(c == SLIP_ESC_END) {
+      c = SLIP_END;
+    } else if(c == SLIP_ESC_ESC) {
+      c = SLIP_ESC;
+    } else if(c == SLIP_ESC_XON) {
+      c = XON;
+    } else if(c == SLIP_ESC_XOFF) {
+      c = XOFF;
+    }
+  } else if(c == SLIP_ESC) {
+    rx->esc = 1;
+    return 0;
+  }
+  if(rx->len == FRAME_MAX) {
+    rx->overflow = 1;
+  } else {
+    rx->buf[rx->len++] = c;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what)
+{
+  fprintf(stderr, "slipmux: %s (bad CRC %lu, bad channel %lu, runts %lu, overlong %lu, no tunslip6 %lu,"
+          " bad IPHC %lu)\n", what, bad_crc, bad_channel, runts, overflows, no_tunslip, bad_iphc);
+}
+/*---------------------------------------------------------------------------*/
+static void
+telemetry(const uint8_t *data, int len)
+{
+  char addr[INET6_ADDRSTRLEN];
+  int i;
+
+  if(len < 16) {
+    return;
+  }
+  inet_ntop(AF_INET6, data, addr, sizeof(addr));
+  printf("T %s ", addr);
+  for(i = 16; i < len; i++) {
+    printf("%02x", data[i]);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+/*---------------------------------------------------------------------------*/
+static speed_t
+baud_speed(int baud)
+{
+  switch(baud) {
+  case 9600: return B9600;
+  case 19200: return B19200;
+  case 38400: return B38400;
+  case 57600: return B57600;
+  case 115200: return B115200;
+#ifdef B230400
+  case 230400: return B230400;
+#endif
+#ifdef B460800
+  case 460800: return B460800;
+#endif
+#ifdef B921600
+  case 921600: return B921600;
+#endif
+  }
+  fprintf(stderr, "slipmux: unsupported baud rate %d\n", baud);
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_control(const char *msg)
+{
+  send_frame(router, CHANNEL_CONTROL, (const uint8_t *)msg, strlen(msg));
+}
+/*---------------------------------------------------------------------------*/
+/* "!B<rate>" from the router, sent at the rate it had */
+static void
+baud_answer(const uint8_t *data, int len)
+{
+  char digits[12];
+  struct termios tty;
+  int rate;
+
+  if(len - 2 >= (int)sizeof(digits)) {
+    return;
+  }
+  memcpy(digits, &data[2], len - 2);
+  digits[len - 2] = '\0';
+  rate = atoi(digits);
+  if(baud_wanted == 0) {
+    fprintf(stderr, "slipmux: router at %d baud\n", rate);
+    return;
+  }
+  if(rate != baud_wanted) {
+    fprintf(stderr, "slipmux: router refused %d baud, stays at %d\n", baud_wanted, rate);
+    baud_wanted = 0;
+    return;
+  }
+  baud_wanted = 0;
+  if(tcgetattr(router, &tty) == 0) {
+    tcdrain(router);
+    cfsetispeed(&tty, baud_speed(rate));
+    cfsetospeed(&tty, baud_speed(rate));
+    tcsetattr(router, TCSANOW, &tty);
+  }
+  /* Anything valid keeps the router at the new rate */
+  send_control("?B");
+  fprintf(stderr, "slipmux: now at %d baud\n", rate);
+}
+/*---------------------------------------------------------------------------*/
+/* Address mode as in slip-bridge.h */
+static int
+expand_addr(uint8_t mode, const uint8_t *in, int *pos, int len, uint8_t *a)
+{
+  static const uint8_t linklocal[8] = { 0xfe, 0x80 };
+  int n = (mode & 3) == 0 ? 16 : (mode & 3) == 1 ? 8 : 2;
+
+  if((mode & 3) == 3 || *pos + n > len) {
+    return 0;
+  }
+  if((mode & 3) == 0) {
+    memcpy(a, &in[*pos], 16);
+  } else {
+    if(mode & 4) {
+      if(!context_set) {
+        return 0;
+      }
+      memcpy(a, context, 8);
+    } else {
+      memcpy(a, linklocal, 8);
+    }
+    if((mode & 3) == 1) {
+      memcpy(&a[8], &in[*pos], 8);
+    } else {
+      memset(&a[8], 0, 6);
+      a[11] = 0xff;
+      a[12] = 0xfe;
+      memcpy(&a[14], &in[*pos], 2);
+    }
+  }
+  *pos += n;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Rebuilds the IPv6 packet of an IPHC frame for tunslip6 */
+static void
+iphc_frame(const uint8_t *in, int len)
+{
+  static const uint8_t hop_limits[4] = { 0, 1, 64, 255 };
+  static uint8_t pkt[FRAME_MAX + 48];
+  int pos = 2, n = 40, plen;
+  uint8_t f0, f1;
+
+  if(len < 2) {
+    goto bad;
+  }
+  f0 = in[0];
+  f1 = in[1];
+  if(f0 & 0x80) {
+    pkt[0] = 0x60;
+    pkt[1] = pkt[2] = pkt[3] = 0;
+  } else {
+    if(pos + 4 > len) {
+      goto bad;
+    }
+    memcpy(pkt, &in[pos], 4);
+    pos += 4;
+  }
+  if(f0 & 0x40) {
+    pkt[6] = 17;
+  } else {
+    if(pos + 1 > len) {
+      goto bad;
+    }
+    pkt[6] = in[pos++];
+  }
+  if(((f0 >> 4) & 3) == 0) {
+    if(pos + 1 > len) {
+      goto bad;
+    }
+    pkt[7] = in[pos++];
+  } else {
+    pkt[7] = hop_limits[(f0 >> 4) & 3];
+  }
+  if(!expand_addr((f1 >> 4) & 7, in, &pos, len, &pkt[8]) ||
+     !expand_addr(f1 & 7, in, &pos, len, &pkt[24])) {
+    goto bad;
+  }
+  if(f0 & 0x40) {
+    if(pos + 6 > len) {
+      goto bad;
+    }
+    memcpy(&pkt[40], &in[pos], 4);
+    memcpy(&pkt[46], &in[pos + 4], 2);
+    pos += 6;
+    n = 48;
+  }
+  memcpy(&pkt[n], &in[pos], len - pos);
+  n += len - pos;
+  plen = n - 40;
+  pkt[4] = plen >> 8;
+  pkt[5] = plen & 0xff;
+  if(f0 & 0x40) {
+    pkt[44] = plen >> 8;
+    pkt[45] = plen & 0xff;
+  }
+  if(tunslip < 0) {
+    no_tunslip++;
+    return;
+  }
+  send_frame(tunslip, -1, pkt, n);
+  return;
+
+bad:
+  bad_iphc++;
+  report("bad IPHC frame");
+}
+/*---------------------------------------------------------------------------*/
+/* "!C<prefix>" from the router, or "!C" while it has none */
+static void
+context_answer(const uint8_t *data, int len)
+{
+  context_set = len == 10;
+  if(context_set) {
+    memcpy(context, &data[2], 8);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+router_frame(struct slip_rx *rx)
+{
+  uint16_t crc = 0;
+  int i, len = rx->len;
+
+  rx->len = 0;
+  if(len < 3) {
+    runts++;
+    report("runt");
+    return;
+  }
+  for(i = 0; i < len - 2; i++) {
+    crc = crc16_add(rx->buf[i], crc);
+  }
+  if(crc != ((rx->buf[len - 2] << 8) | rx->buf[len - 1])) {
+    bad_crc++;
+    report("bad CRC");
+    return;
+  }
+  len -= 3;
+  switch(rx->buf[0]) {
+  case CHANNEL_CONTROL:
+    if(len >= 2 && rx->buf[1] == '!' && rx->buf[2] == 'B') {
+      baud_answer(&rx->buf[1], len);
+      break;
+    }
+    if(len >= 2 && rx->buf[1] == '!' && rx->buf[2] == 'C') {
+      context_answer(&rx->buf[1], len);
+      break;
+    }
+    /* Fall through */
+  case CHANNEL_IP:
+    if(tunslip < 0) {
+      no_tunslip++;
+      break;
+    }
+    send_frame(tunslip, -1, &rx->buf[1], len);
+    break;
+  case CHANNEL_DEBUG:
+    fwrite(&rx->buf[1], 1, len, stdout);
+    fflush(stdout);
+    break;
+  case CHANNEL_TELEMETRY:
+    telemetry(&rx->buf[1], len);
+    break;
+  case CHANNEL_IPHC:
+    iphc_frame(&rx->buf[1], len);
+    break;
+  default:
+    bad_channel++;
+    report("bad channel");
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+tunslip_frame(struct slip_rx *rx)
+{
+  /* tunslip6 marks its configuration messages the way slip-bridge.c did */
+  int channel = rx->buf[0] == '!' || rx->buf[0] == '?' ? CHANNEL_CONTROL : CHANNEL_IP;
+
+  if(rx->len >= 10 && rx->buf[0] == '!' && rx->buf[1] == 'P') {
+    /* The prefix the router compresses against */
+    memcpy(context, &rx->buf[2], 8);
+    context_set = 1;
+  }
+  send_frame(router, channel, rx->buf, rx->len);
+  rx->len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_serial(const char *device, int baud, int rtscts)
+{
+  struct termios tty;
+  int fd;
+
+  fd = open(device, O_RDWR | O_NOCTTY);
+  if(fd < 0 || tcgetattr(fd, &tty) < 0) {
+    perror(device);
+    exit(1);
+  }
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  if(rtscts) {
+    tty.c_cflag |= CRTSCTS;
+  }
+  if(xonxoff) {
+    /* The tty driver takes XON and XOFF out and sends them for us */
+    tty.c_iflag |= IXON | IXOFF;
+  }
+  cfsetispeed(&tty, baud_speed(baud));
+  cfsetospeed(&tty, baud_speed(baud));
+  if(tcsetattr(fd, TCSAFLUSH, &tty) < 0) {
+    perror(device);
+    exit(1);
+  }
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_socket(const char *host, const char *port, int listening)
+{
+  struct addrinfo hints, *res, *ai;
+  int fd = -1, on = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  if(getaddrinfo(host, port, &hints, &res) != 0) {
+    fprintf(stderr, "slipmux: cannot resolve %s:%s\n", host ? host : "*", port);
+    exit(1);
+  }
+  for(ai = res; ai != NULL; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(fd < 0) {
+      continue;
+    }
+    if(listening) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0) {
+        break;
+      }
+    } else if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if(fd < 0) {
+    fprintf(stderr, "slipmux: cannot %s %s:%s\n", listening ? "listen on" : "connect to",
+            host ? host : "*", port);
+    exit(1);
+  }
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  static struct slip_rx from_router, from_tunslip;
+  const char *device = "/dev/ttyUSB0", *host = NULL, *port = "60001", *listen_port = "60002";
+  uint8_t buf[512];
+  int baud = 115200, rtscts = 0, c, i, maxfd;
+  ssize_t n;
+  fd_set fds;
+
+  while((c = getopt(argc, argv, "s:B:b:xra:p:L:")) != -1) {
+    switch(c) {
+    case 's': device = optarg; break;
+    case 'B': baud = atoi(optarg); break;
+    case 'b': baud_wanted = atoi(optarg); break;
+    case 'x': xonxoff = 1; break;
+    case 'r': rtscts = 1; break;
+    case 'a': host = optarg; break;
+    case 'p': port = optarg; break;
+    case 'L': listen_port = optarg; break;
+    default:
+      fprintf(stderr, "usage: %s [-s device] [-B baud] [-b baud] [-x | -r] [-a host -p port] [-L listen port]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  router = host != NULL ? open_socket(host, port, 0) : open_serial(device, baud, rtscts);
+  listener = open_socket(NULL, listen_port, 1);
+  /* A router that has been up for a while already has its prefix */
+  send_control("?C");
+  if(baud_wanted != 0) {
+    if(host != NULL) {
+      /* A socket has no rate of its own to follow the router with */
+      baud_wanted = 0;
+    } else {
+      baud_speed(baud_wanted);
+      snprintf((char *)buf, sizeof(buf), "!B%d", baud_wanted);
+      send_control((char *)buf);
+    }
+  }
+  fprintf(stderr, "slipmux: waiting for tunslip6 -a 127.0.0.1 -p %s\n", listen_port);
+
+  while(1) {
+    FD_ZERO(&fds);
+    FD_SET(router, &fds);
+    FD_SET(listener, &fds);
+    maxfd = router > listener ? router : listener;
+    if(tunslip >= 0) {
+      FD_SET(tunslip, &fds);
+      maxfd = tunslip > maxfd ? tunslip : maxfd;
+    }
+    if(select(maxfd + 1, &fds, NULL, NULL, NULL) < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      perror("slipmux: select");
+      return 1;
+    }
+
+    if(FD_ISSET(listener, &fds)) {
+      /* A new tunslip6 replaces the old one */
+      if(tunslip >= 0) {
+        close(tunslip);
+      }
+      tunslip = accept(listener, NULL, NULL);
+      from_tunslip.len = 0;
+      from_tunslip.esc = 0;
+      from_tunslip.overflow = 0;
+      fprintf(stderr, "slipmux: tunslip6 connected\n");
+    }
+
+    if(FD_ISSET(router, &fds)) {
+      n = read(router, buf, sizeof(buf));
+      if(n <= 0) {
+        fprintf(stderr, "slipmux: border router went away\n");
+        return 1;
+      }
+      for(i = 0; i < n; i++) {
+        if(slip_rx_byte(&from_router, buf[i])) {
+          router_frame(&from_router);
+        }
+      }
+    }
+
+    if(tunslip >= 0 && FD_ISSET(tunslip, &fds)) {
+      n = read(tunslip, buf, sizeof(buf));
+      if(n <= 0) {
+        fprintf(stderr, "slipmux: tunslip6 went away\n");
+        close(tunslip);
+        tunslip = -1;
+        continue;
+      }
+      for(i = 0; i < n; i++) {
+        if(slip_rx_byte(&from_tunslip, buf[i])) {
+          tunslip_frame(&from_tunslip);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,516 @@
+#include "contiki.h"
+#include "contiki-lib.h"
+#include "contiki-net.h"
+#include "lib/crc16.h"
+#include "lib/trickle-timer.h"
+#include "net/ip/uip.h"
+#include "net/ip/uip-debug.h"
+
+#include "config-dissem.h"
+#include "wire.h"
+
+#include <string.h>
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/*
+ * Trickle only carries a short advertisement of the table digest. A node
+ * that hears a different digest unicasts a request holding its own
+ * (selector, version) summary to the advertiser, which answers with just
+ * the entries the requester is missing or has an older version of.
+ *
+ *   ADV:  type, count (varint), digest (u16)
+ *   REQ:  type, { selector, version (u16) } ...
+ *   DATA: type, { selector, interval (varint), version (u16) } ...
+ *
+ * A selector is its type (u8) and lo (varint), followed by hi (varint)
+ * for every type but CONFIG_SEL_NODE.
+ *
+ * The Trickle parameters are one more record with its own version. In
+ * place of a selector it has RECORD_TRICKLE, and its data is
+ * imin (varint, ms), imax (u8), k (u8), version (u16).
+ *
+ * Anyone can unicast a STATS_REQ to read the counters of a node:
+ *
+ *   STATS: type, the fields of struct config_dissem_stats in order (varint)
+ */
+#define MSG_ADV  0
+#define MSG_REQ  1
+#define MSG_DATA 2
+#define MSG_STATS_REQ 3
+#define MSG_STATS 4
+
+#define RECORD_TRICKLE 0xff
+
+#define SELECTOR_MAX_LEN 7
+#define SUMMARY_MAX_LEN  (SELECTOR_MAX_LEN + 2)
+#define ENTRY_MAX_LEN    (SELECTOR_MAX_LEN + 5)
+
+/* Room left for the payload once the IPv6 and UDP headers are accounted for */
+#define PACKET_PAYLOAD (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN)
+
+/* Set to log the size of every message sent, next to what an
+ * advertisement carrying the whole table would take (trickle-bytes.csc) */
+#ifdef CONFIG_DISSEM_CONF_LOG_BYTES
+#define LOG_BYTES CONFIG_DISSEM_CONF_LOG_BYTES
+#else
+#define LOG_BYTES 0
+#endif
+
+static struct uip_udp_conn *trickle_conn;
+static struct trickle_timer tt;
+static uint8_t packet[PACKET_PAYLOAD];
+static uip_ipaddr_t ipaddr;
+static config_dissem_callback_t callback;
+static uint8_t requested; /* A request was sent during this interval */
+static uint16_t applied_version; /* Ours when an advertisement last matched */
+
+static struct config_trickle params = { CONFIG_DISSEM_IMIN, CONFIG_DISSEM_IMAX, CONFIG_DISSEM_K, 0 };
+static uint8_t params_set; /* params came from the root and have a version */
+
+static struct config_dissem_stats stats;
+static unsigned long change_s; /* When the last change was learned */
+static clock_time_t change_t;
+
+/*---------------------------------------------------------------------------*/
+/* Before the digest, every advertisement held the table in the DATA
+ * encoding behind the digest and count, a packet of it at a time */
+static uint16_t
+full_table_len(void)
+{
+  struct config_entry *e;
+  uint16_t len;
+  uint8_t i;
+
+  len = 3 + wire_varint_len(config_table_count() + params_set);
+  if (params_set) len += 5 + wire_varint_len(params.imin);
+  for (i = 0; i < config_table_count(); i++)
+  {
+    e = config_table_get(i);
+    len += 3 + wire_varint_len(e->sel.lo) + wire_varint_len(e->interval);
+    if (e->sel.type != CONFIG_SEL_NODE) len += wire_varint_len(e->sel.hi);
+  }
+  return len < PACKET_PAYLOAD ? len : PACKET_PAYLOAD;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_to(const uip_ipaddr_t *to, const struct wire *w)
+{
+  if (LOG_BYTES) printf("Trickle bytes: type %u len %u full %u\n", w->start[0], wire_len(w), full_table_len());
+
+  uip_ipaddr_copy(&trickle_conn->ripaddr, to);
+  uip_udp_packet_send(trickle_conn, w->start, wire_len(w));
+
+  /* Restore to 'accept incoming from any IP' */
+  uip_create_unspecified(&trickle_conn->ripaddr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+stats_change(void)
+{
+  stats.updates++;
+  stats.update_msgs = 0;
+  stats.converge_ms = 0;
+  change_s = clock_seconds();
+  change_t = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+static void
+stats_reset(void)
+{
+  /* Resets that find the timer at Imin already change nothing */
+  if (tt.i_cur != tt.i_min) stats.resets++;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+since_change_ms(void)
+{
+  unsigned long s = clock_seconds() - change_s;
+
+  /* Ticks are exact but a 16-bit clock wraps, so past a minute seconds do */
+  if (s < 60) return ((unsigned long)(clock_time_t)(clock_time() - change_t) * 1000) / CLOCK_SECOND;
+  return s * 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_stats(const uip_ipaddr_t *to)
+{
+  struct wire w;
+
+  wire_init(&w, packet, sizeof(packet));
+  wire_put_u8(&w, MSG_STATS);
+  wire_put_varint(&w, stats.tx);
+  wire_put_varint(&w, stats.suppressed);
+  wire_put_varint(&w, stats.consistent);
+  wire_put_varint(&w, stats.inconsistent);
+  wire_put_varint(&w, stats.resets);
+  wire_put_varint(&w, stats.requests);
+  wire_put_varint(&w, stats.data);
+  wire_put_varint(&w, stats.updates);
+  wire_put_varint(&w, stats.update_msgs);
+  wire_put_varint(&w, stats.converge_ms);
+  send_to(to, &w);
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_selector(struct wire *w, const struct config_selector *sel)
+{
+  wire_put_u8(w, sel->type);
+  wire_put_varint(w, sel->lo);
+  if (sel->type != CONFIG_SEL_NODE) wire_put_varint(w, sel->hi);
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_selector(struct wire *w, struct config_selector *sel)
+{
+  sel->type = wire_get_u8(w);
+  if (sel->type == RECORD_TRICKLE)
+  {
+    sel->lo = sel->hi = 0;
+    return;
+  }
+  sel->lo = wire_get_varint(w);
+  sel->hi = sel->type != CONFIG_SEL_NODE ? wire_get_varint(w) : 0;
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+params_ticks(uint16_t imin)
+{
+  return (clock_time_t)(((unsigned long)imin * CLOCK_SECOND) / 1000);
+}
+/*---------------------------------------------------------------------------*/
+/* The bounds trickle_timer_config() checks: Imin of at least 2 ticks,
+ * Imax and k not 0, and Imin doubled Imax times within half the range of
+ * clock_time_t. Ticks are those of this node's clock. */
+static int
+params_valid(uint16_t imin, uint8_t imax, uint8_t k)
+{
+  clock_time_t ticks = params_ticks(imin);
+
+  return ticks >= 2 && imax > 0 && imax <= CONFIG_DISSEM_IMAX_MAX && k > 0 &&
+         ((unsigned long)(clock_time_t)~0 >> (imax + 1)) >= ticks;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns 0 if the timer refused p, and keeps the parameters it had */
+static int
+params_apply(const struct config_trickle *p)
+{
+  /* Reconfigured in place: the current interval and counter are kept, and
+   * the next interval follows the new bounds */
+  if (trickle_timer_config(&tt, params_ticks(p->imin), p->imax, p->k) != TRICKLE_TIMER_SUCCESS)
+  {
+    PRINTF("Trickle refused Imin %ums, Imax %u, k %u\n", p->imin, p->imax, p->k);
+    return 0;
+  }
+  if (tt.i_cur > tt.i_max_abs)
+  {
+    tt.i_cur = tt.i_max_abs;
+  }
+  PRINTF("Trickle Imin %ums, Imax %u, k %u (version 0x%04x)\n", p->imin, p->imax, p->k, p->version);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+params_hash(void)
+{
+  uint16_t acc;
+
+  acc = crc16_add(RECORD_TRICKLE, 0);
+  acc = crc16_add(params.imin & 0xff, acc);
+  acc = crc16_add(params.imin >> 8, acc);
+  acc = crc16_add(params.imax, acc);
+  acc = crc16_add(params.k, acc);
+  acc = crc16_add(params.version & 0xff, acc);
+  return crc16_add(params.version >> 8, acc);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+local_digest(void)
+{
+  return config_table_digest() + (params_set ? params_hash() : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_request(const uip_ipaddr_t *to)
+{
+  struct config_entry *e;
+  struct wire w;
+  uint8_t i;
+
+  wire_init(&w, packet, sizeof(packet));
+  wire_put_u8(&w, MSG_REQ);
+  if (params_set)
+  {
+    wire_put_u8(&w, RECORD_TRICKLE);
+    wire_put_u16(&w, params.version);
+  }
+  for (i = 0; i < config_table_count() && wire_left(&w) >= SUMMARY_MAX_LEN; i++)
+  {
+    e = config_table_get(i);
+    put_selector(&w, &e->sel);
+    wire_put_u16(&w, e->version);
+  }
+  stats.requests++;
+  stats.update_msgs++;
+  PRINTF("Request %u summaries from ", i);
+  PRINT6ADDR(to);
+  PRINTF("\n");
+  send_to(to, &w);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_data(struct wire *req, const uip_ipaddr_t *to)
+{
+  uint8_t uptodate[CONFIG_TABLE_SIZE];
+  struct config_entry *e;
+  struct config_selector sel;
+  struct wire w;
+  uint16_t version;
+  uint8_t params_uptodate = !params_set;
+  uint8_t i, n;
+
+  /* Mark the entries the requester already has in at least our version */
+  memset(uptodate, 0, sizeof(uptodate));
+  while (wire_left(req) > 0)
+  {
+    get_selector(req, &sel);
+    version = wire_get_u16(req);
+    if (req->error) return;
+    if (sel.type == RECORD_TRICKLE)
+    {
+      if (!config_version_newer(params.version, version)) params_uptodate = 1;
+      continue;
+    }
+    for (i = 0; i < config_table_count(); i++)
+    {
+      e = config_table_get(i);
+      if (config_selector_equal(&e->sel, &sel) && !config_version_newer(e->version, version)) uptodate[i] = 1;
+    }
+  }
+
+  wire_init(&w, packet, sizeof(packet));
+  wire_put_u8(&w, MSG_DATA);
+  n = 0;
+  if (!params_uptodate)
+  {
+    wire_put_u8(&w, RECORD_TRICKLE);
+    wire_put_varint(&w, params.imin);
+    wire_put_u8(&w, params.imax);
+    wire_put_u8(&w, params.k);
+    wire_put_u16(&w, params.version);
+    n++;
+  }
+  for (i = 0; i < config_table_count() && wire_left(&w) >= ENTRY_MAX_LEN; i++)
+  {
+    if (uptodate[i]) continue;
+    e = config_table_get(i);
+    put_selector(&w, &e->sel);
+    wire_put_varint(&w, e->interval);
+    wire_put_u16(&w, e->version);
+    n++;
+  }
+  if (n == 0) return;
+
+  stats.data++;
+  stats.update_msgs++;
+  PRINTF("Send %u entries to ", n);
+  PRINT6ADDR(to);
+  PRINTF("\n");
+  send_to(to, &w);
+}
+/*---------------------------------------------------------------------------*/
+static void
+merge_params(struct wire *w)
+{
+  struct config_trickle p;
+
+  p.imin = wire_get_varint(w);
+  p.imax = wire_get_u8(w);
+  p.k = wire_get_u8(w);
+  p.version = wire_get_u16(w);
+  if (w->error || !params_valid(p.imin, p.imax, p.k)) return;
+  if (params_set && !config_version_newer(p.version, params.version)) return;
+  /* Only what the timer took is reported and acked */
+  if (!params_apply(&p)) return;
+
+  params = p;
+  params_set = 1;
+  config_table_seed(p.version);
+  stats_change();
+}
+/*---------------------------------------------------------------------------*/
+static void
+merge_data(struct wire *w)
+{
+  struct config_entry e;
+
+  while (wire_left(w) > 0)
+  {
+    get_selector(w, &e.sel);
+    if (e.sel.type == RECORD_TRICKLE)
+    {
+      merge_params(w);
+      continue;
+    }
+    e.interval = wire_get_varint(w);
+    e.version = wire_get_u16(w);
+    if (w->error) return;
+    if (config_table_merge(&e))
+    {
+      stats_change();
+      PRINTF("Selector %u [%u, %u] => interval %u (version 0x%04x)\n", e.sel.type, e.sel.lo, e.sel.hi, e.interval, e.version);
+      if (callback != NULL) callback(&e);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+config_dissem_input(void)
+{
+  uip_ipaddr_t sender;
+  struct wire w;
+  uint16_t digest, theirs;
+  uint16_t count; /* Entries and the Trickle record, so up to 256 */
+
+  if (!uip_newdata()) return;
+
+  /* Replies overwrite uip_buf, keep the address of who to answer */
+  uip_ipaddr_copy(&sender, &UIP_IP_BUF->srcipaddr);
+
+  wire_init(&w, uip_appdata, uip_datalen());
+  switch (wire_get_u8(&w))
+  {
+  case MSG_ADV:
+    count = wire_get_varint(&w);
+    theirs = wire_get_u16(&w);
+    if (w.error) return;
+    digest = local_digest();
+    PRINTF("At %lu (I=%lu, c=%u): ", (unsigned long)clock_time(), (unsigned long)tt.i_cur, tt.c);
+    PRINTF("Our digest=0x%04x, theirs=0x%04x\n", digest, theirs);
+    if (digest == theirs)
+    {
+      PRINTF("Consistent RX\n");
+      stats.consistent++;
+      applied_version = config_table_version();
+      trickle_timer_consistency(&tt);
+      return;
+    }
+
+    /* Either side may be behind. Our request carries what we have, so the
+     * advertiser only sends what we lack; if they lack something, their
+     * own request after our next advertisement fixes it. */
+    if (!requested && count > 0)
+    {
+      requested = 1;
+      send_request(&sender);
+    }
+    stats.inconsistent++;
+    stats_reset();
+    trickle_timer_inconsistency(&tt);
+    PRINTF("At %lu: Trickle inconsistency. Scheduled TX for %lu\n", (unsigned long)clock_time(), (unsigned long)(tt.ct.etimer.timer.start + tt.ct.etimer.timer.interval));
+    break;
+  case MSG_REQ:
+    send_data(&w, &sender);
+    break;
+  case MSG_DATA:
+    merge_data(&w);
+    break;
+  case MSG_STATS_REQ:
+    send_stats(&sender);
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+config_dissem_applied(void)
+{
+  return applied_version;
+}
+/*---------------------------------------------------------------------------*/
+static void
+trickle_tx(void *ptr, uint8_t suppress)
+{
+  struct trickle_timer *loc_tt = (struct trickle_timer *)ptr;
+  uint8_t adv[8];
+  struct wire w;
+
+  /* Called once per interval: allow a new request */
+  requested = 0;
+
+  if (suppress == TRICKLE_TIMER_TX_SUPPRESS)
+  {
+    stats.suppressed++;
+    return;
+  }
+  stats.tx++;
+  stats.update_msgs++;
+  if (stats.updates > 0) stats.converge_ms = since_change_ms();
+
+  wire_init(&w, adv, sizeof(adv));
+  wire_put_u8(&w, MSG_ADV);
+  wire_put_varint(&w, config_table_count() + params_set);
+  wire_put_u16(&w, local_digest());
+
+  PRINTF("At %lu (I=%lu, c=%u): ", (unsigned long)clock_time(), (unsigned long)loc_tt->i_cur, loc_tt->c);
+  PRINTF("Trickle TX digest 0x%04x\n", local_digest());
+
+  /* Destination IP: link-local all-nodes multicast */
+  send_to(&ipaddr, &w);
+}
+/*---------------------------------------------------------------------------*/
+void
+config_dissem_changed(void)
+{
+  PRINTF("At %lu: New config version 0x%04x\n", (unsigned long)clock_time(), config_table_version());
+  stats_change();
+  stats_reset();
+  trickle_timer_reset_event(&tt);
+}
+/*---------------------------------------------------------------------------*/
+void
+config_dissem_init(config_dissem_callback_t applied)
+{
+  callback = applied;
+  config_table_init();
+
+  uip_create_linklocal_allnodes_mcast(&ipaddr);
+
+  trickle_conn = udp_new(NULL, UIP_HTONS(TRICKLE_PROTO_PORT), NULL);
+  udp_bind(trickle_conn, UIP_HTONS(TRICKLE_PROTO_PORT));
+
+  PRINTF("Connection: local/remote port %u/%u\n", UIP_HTONS(trickle_conn->lport), UIP_HTONS(trickle_conn->rport));
+
+  params_apply(&params);
+  trickle_timer_set(&tt, trickle_tx, &tt);
+}
+/*---------------------------------------------------------------------------*/
+int
+config_dissem_set_trickle(uint16_t imin, uint8_t imax, uint8_t k)
+{
+  struct config_trickle p;
+
+  if (!params_valid(imin, imax, k)) return -1;
+  if (params_set && params.imin == imin && params.imax == imax && params.k == k) return 0;
+
+  p.imin = imin;
+  p.imax = imax;
+  p.k = k;
+  p.version = config_table_originate();
+  if (!params_apply(&p)) return -1;
+  params = p;
+  params_set = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+const struct config_trickle *
+config_dissem_trickle(void)
+{
+  return &params;
+}
+/*---------------------------------------------------------------------------*/
+const struct config_dissem_stats *
+config_dissem_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
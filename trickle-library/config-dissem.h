@@ -0,0 +1,88 @@
+/**
+ * \file
+ *         Trickle dissemination of the configuration table, shared by the
+ *         border router and the sensor nodes.
+ */
+
+#ifndef CONFIG_DISSEM_H_
+#define CONFIG_DISSEM_H_
+
+#include "config-table.h"
+
+#define TRICKLE_PROTO_PORT 30001
+
+/*
+ * Trickle parameters the timer starts with, until the root disseminates
+ * others. Imin is in milliseconds so that it means the same on every
+ * platform.
+ */
+#ifdef CONFIG_DISSEM_CONF_IMIN
+#define CONFIG_DISSEM_IMIN CONFIG_DISSEM_CONF_IMIN
+#else
+#define CONFIG_DISSEM_IMIN 125 /* ms */
+#endif
+
+#ifdef CONFIG_DISSEM_CONF_IMAX
+#define CONFIG_DISSEM_IMAX CONFIG_DISSEM_CONF_IMAX
+#else
+#define CONFIG_DISSEM_IMAX 10 /* doublings */
+#endif
+
+#ifdef CONFIG_DISSEM_CONF_K
+#define CONFIG_DISSEM_K CONFIG_DISSEM_CONF_K
+#else
+#define CONFIG_DISSEM_K 2
+#endif
+
+#define CONFIG_DISSEM_IMAX_MAX 20
+
+struct config_trickle
+{
+  uint16_t imin; /* ms */
+  uint8_t imax;  /* doublings */
+  uint8_t k;     /* redundancy constant, at least 1 */
+  uint16_t version;
+};
+
+/* Dissemination counters, kept in RAM and cheap enough to leave on */
+struct config_dissem_stats
+{
+  uint32_t tx;           /* Advertisements sent */
+  uint32_t suppressed;   /* Advertisements suppressed by k */
+  uint32_t consistent;   /* Advertisements heard with our digest */
+  uint32_t inconsistent; /* Advertisements heard with another digest */
+  uint32_t resets;       /* Times the interval went back to Imin */
+  uint32_t requests;     /* Requests sent */
+  uint32_t data;         /* Data answers sent */
+  uint32_t updates;      /* Changes learned or originated */
+  uint32_t update_msgs;  /* Messages sent since the last change */
+  uint32_t converge_ms;  /* From the last change to our last advertisement */
+};
+
+/* Called for every entry that a received update changed */
+typedef void (*config_dissem_callback_t)(const struct config_entry *e);
+
+/* Must be called from the process that will receive the tcpip_events */
+void config_dissem_init(config_dissem_callback_t applied);
+void config_dissem_input(void);
+
+/* The newest version the node is known to hold all of: the last time a
+ * neighbour's advertisement matched our digest, this was our version.
+ * Entries arrive one update at a time, so config_table_version() can be
+ * ahead of what the table holds. */
+uint16_t config_dissem_applied(void);
+
+/* The local table was changed: make the network pick it up */
+void config_dissem_changed(void);
+
+/* Root only: retune every Trickle timer in the network. Returns 1 if the
+ * parameters changed, 0 if they are the ones in effect, -1 if they are out
+ * of the range trickle_timer_config() takes. A node applies and acks only
+ * parameters its own timer takes. */
+int config_dissem_set_trickle(uint16_t imin, uint8_t imax, uint8_t k);
+
+const struct config_trickle *config_dissem_trickle(void);
+
+const struct config_dissem_stats *config_dissem_stats(void);
+
+#endif /* CONFIG_DISSEM_H_ */
@@ -0,0 +1,215 @@
+#include "contiki.h"
+#include "lib/crc16.h"
+
+#include "config-table.h"
+
+#include <string.h>
+
+static struct config_entry table[CONFIG_TABLE_SIZE];
+static uint8_t count;
+static uint16_t version;  /* Newest version seen or originated */
+static uint8_t versioned; /* version holds something */
+
+/*---------------------------------------------------------------------------*/
+int
+config_version_newer(uint16_t a, uint16_t b)
+{
+  uint16_t d;
+
+  if (a > CONFIG_VERSION_CIRCULAR && b > CONFIG_VERSION_CIRCULAR) return a > b;
+  if (a <= CONFIG_VERSION_CIRCULAR && b <= CONFIG_VERSION_CIRCULAR)
+  {
+    /* Serial number arithmetic over the circular region */
+    d = (a - b) & CONFIG_VERSION_CIRCULAR;
+    return d != 0 && d <= CONFIG_VERSION_CIRCULAR / 2;
+  }
+  /* One value in each region: the circular one is newer only if it is
+   * close enough ahead of the linear one to be its successor */
+  if (a <= CONFIG_VERSION_CIRCULAR) return (uint16_t)(a - b) <= CONFIG_VERSION_WINDOW;
+  return (uint16_t)(b - a) > CONFIG_VERSION_WINDOW;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+config_version_next(uint16_t v)
+{
+  return v == CONFIG_VERSION_CIRCULAR ? 0 : (uint16_t)(v + 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+version_seen(uint16_t v)
+{
+  if (!versioned || config_version_newer(v, version))
+  {
+    version = v;
+    versioned = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+config_table_init(void)
+{
+  count = 0;
+  version = 0;
+  versioned = 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+config_table_count(void)
+{
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+struct config_entry *
+config_table_get(uint8_t i)
+{
+  return i < count ? &table[i] : NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+config_selector_equal(const struct config_selector *a, const struct config_selector *b)
+{
+  return a->type == b->type && a->lo == b->lo && a->hi == b->hi;
+}
+/*---------------------------------------------------------------------------*/
+int
+config_selector_match(const struct config_selector *sel, uint16_t node, uint16_t rank)
+{
+  switch (sel->type)
+  {
+  case CONFIG_SEL_NODE:
+    return sel->lo == CONFIG_NODE_ALL || sel->lo == node;
+  case CONFIG_SEL_RANGE:
+    return node >= sel->lo && node <= sel->hi;
+  case CONFIG_SEL_BITMAP:
+    return node >= sel->lo && node - sel->lo < 16 && (sel->hi >> (node - sel->lo)) & 1;
+  case CONFIG_SEL_RANK:
+    return rank >= sel->lo && rank <= sel->hi;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+struct config_entry *
+config_table_lookup(const struct config_selector *sel)
+{
+  uint8_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (config_selector_equal(&table[i].sel, sel)) return &table[i];
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+struct config_entry *
+config_table_match(uint16_t node, uint16_t rank)
+{
+  struct config_entry *best = NULL;
+  uint8_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (config_selector_match(&table[i].sel, node, rank) &&
+        (best == NULL || config_version_newer(table[i].version, best->version)))
+    {
+      best = &table[i];
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static struct config_entry *
+oldest_entry(void)
+{
+  uint8_t i, oldest;
+
+  for (i = 1, oldest = 0; i < count; i++)
+  {
+    if (config_version_newer(table[oldest].version, table[i].version)) oldest = i;
+  }
+  return &table[oldest];
+}
+/*---------------------------------------------------------------------------*/
+int
+config_table_merge(const struct config_entry *e)
+{
+  struct config_entry *cur = config_table_lookup(&e->sel);
+
+  if (cur == NULL)
+  {
+    if (count < CONFIG_TABLE_SIZE) cur = &table[count++];
+    else
+    {
+      /* Full: the oldest entry has had the longest time to converge, so it
+       * is recycled. Every replica applies the same rule and ends up with
+       * the same set of entries. */
+      cur = oldest_entry();
+      if (!config_version_newer(e->version, cur->version)) return 0;
+    }
+  }
+  else if (!config_version_newer(e->version, cur->version)) return 0;
+
+  cur->sel = e->sel;
+  cur->interval = e->interval;
+  cur->version = e->version;
+  version_seen(e->version);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+struct config_entry *
+config_table_set(const struct config_selector *sel, uint16_t interval)
+{
+  struct config_entry e;
+
+  e.sel = *sel;
+  e.interval = interval;
+  e.version = config_table_originate();
+  config_table_merge(&e);
+  return config_table_lookup(sel);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+config_table_originate(void)
+{
+  version_seen(versioned ? config_version_next(version) : CONFIG_VERSION_INIT);
+  return version;
+}
+/*---------------------------------------------------------------------------*/
+void
+config_table_seed(uint16_t v)
+{
+  version_seen(v);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+entry_hash(const struct config_entry *e)
+{
+  uint16_t acc;
+
+  acc = crc16_add(e->sel.type, 0);
+  acc = crc16_add(e->sel.lo & 0xff, acc);
+  acc = crc16_add(e->sel.lo >> 8, acc);
+  acc = crc16_add(e->sel.hi & 0xff, acc);
+  acc = crc16_add(e->sel.hi >> 8, acc);
+  acc = crc16_add(e->interval & 0xff, acc);
+  acc = crc16_add(e->interval >> 8, acc);
+  acc = crc16_add(e->version & 0xff, acc);
+  return crc16_add(e->version >> 8, acc);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+config_table_digest(void)
+{
+  uint16_t digest = 0;
+  uint8_t i;
+
+  /* A sum of per-entry hashes does not depend on the table order */
+  for (i = 0; i < count; i++) digest += entry_hash(&table[i]);
+  return digest;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+config_table_version(void)
+{
+  return version;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,99 @@
+/**
+ * \file
+ *         Versioned configuration table disseminated with Trickle.
+ *
+ *         Every entry carries its own version so that changes for different
+ *         nodes coexist and converge independently. Replicas compare the
+ *         order-independent digest of their tables instead of a single token.
+ */
+
+#ifndef CONFIG_TABLE_H_
+#define CONFIG_TABLE_H_
+
+#include "contiki.h"
+
+#ifdef CONFIG_TABLE_CONF_SIZE
+#define CONFIG_TABLE_SIZE CONFIG_TABLE_CONF_SIZE
+#else
+#define CONFIG_TABLE_SIZE 16
+#endif
+/* Entries are counted and indexed in a uint8_t */
+#if CONFIG_TABLE_SIZE > 255
+#error "CONFIG_TABLE_CONF_SIZE must be at most 255"
+#endif
+
+/*
+ * An entry applies to the nodes picked by its selector, so one update
+ * can retune a whole region. When several entries match a node, the
+ * newest one wins.
+ */
+#define CONFIG_SEL_NODE   0 /* Node id lo, or every node if lo is 0 */
+#define CONFIG_SEL_RANGE  1 /* Node ids lo..hi */
+#define CONFIG_SEL_BITMAP 2 /* Node id lo + i for every bit i set in hi */
+#define CONFIG_SEL_RANK   3 /* Nodes whose RPL DAG_RANK() is lo..hi */
+
+#define CONFIG_NODE_ALL 0
+
+struct config_selector
+{
+  uint8_t type;
+  uint16_t lo;
+  uint16_t hi;
+};
+
+/*
+ * Versions are 16-bit lollipop counters as in RFC 6550: they start in a
+ * linear region at CONFIG_VERSION_INIT and wrap into a circular region
+ * 0..CONFIG_VERSION_CIRCULAR. A root that restarts without its saved
+ * counter begins again at CONFIG_VERSION_INIT, which is newer than any
+ * circular value not within CONFIG_VERSION_WINDOW ahead of it, so its
+ * commands take effect at once instead of after a wraparound. Once its
+ * own counter has wrapped, though, circular versions it never heard
+ * still rank by the circular comparison and may outrank it; the root
+ * therefore takes up the version it hears before originating (see
+ * config_table_seed()) rather than relying on the restart.
+ */
+#define CONFIG_VERSION_CIRCULAR 0x7fff
+#define CONFIG_VERSION_WINDOW   16
+#define CONFIG_VERSION_INIT     ((uint16_t)(0x10000UL - CONFIG_VERSION_WINDOW))
+
+struct config_entry
+{
+  struct config_selector sel;
+  uint16_t interval; /* Sampling period in seconds */
+  uint16_t version;
+};
+
+void config_table_init(void);
+
+uint8_t config_table_count(void);
+struct config_entry *config_table_get(uint8_t i);
+struct config_entry *config_table_lookup(const struct config_selector *sel);
+
+int config_selector_equal(const struct config_selector *a, const struct config_selector *b);
+int config_selector_match(const struct config_selector *sel, uint16_t node, uint16_t rank);
+
+/* The newest entry that applies to a node, or NULL if none does */
+struct config_entry *config_table_match(uint16_t node, uint16_t rank);
+
+/* Store e if it is newer than what we have. Returns 1 if the table changed */
+int config_table_merge(const struct config_entry *e);
+
+/* Originate a change (root only): the entry gets the next version */
+struct config_entry *config_table_set(const struct config_selector *sel, uint16_t interval);
+
+/* Root only: the version for a new change, numbered after every one seen */
+uint16_t config_table_originate(void);
+
+/* Count v as seen, e.g. a counter saved before a reboot */
+void config_table_seed(uint16_t v);
+
+uint16_t config_table_digest(void);
+
+/* The newest version seen or originated */
+uint16_t config_table_version(void);
+
+int config_version_newer(uint16_t a, uint16_t b);
+uint16_t config_version_next(uint16_t v);
+
+#endif /* CONFIG_TABLE_H_ */
@@ -0,0 +1,125 @@
+#include "contiki.h"
+
+#include "sample-batch.h"
+#include "wire.h"
+
+/*---------------------------------------------------------------------------*/
+static int
+encode_plain(struct wire *w, const struct sample *samples, uint8_t n)
+{
+  uint8_t i;
+
+  wire_put_u8(w, SAMPLE_BATCH_PLAIN);
+  wire_put_varint(w, n);
+  for (i = 0; i < n; i++)
+  {
+    wire_put_svarint(w, samples[i].value);
+    wire_put_varint(w, samples[i].index);
+    wire_put_varint(w, samples[i].interval);
+  }
+  return w->error ? -1 : wire_len(w);
+}
+/*---------------------------------------------------------------------------*/
+static int
+encode_delta(struct wire *w, const struct sample *samples, uint8_t n)
+{
+  uint8_t i, run;
+
+  wire_put_u8(w, SAMPLE_BATCH_DELTA);
+  wire_put_varint(w, n);
+  wire_put_varint(w, samples[0].index);
+  for (i = 0; i < n; i++)
+  {
+    if (i == 0 || samples[i].interval != samples[i - 1].interval)
+    {
+      for (run = 1; i + run < n && samples[i + run].interval == samples[i].interval; run++);
+      wire_put_varint(w, run);
+      wire_put_varint(w, samples[i].interval);
+    }
+    /* Differences wrap around like the values themselves would */
+    wire_put_svarint(w, (int32_t)((uint32_t)samples[i].value - (uint32_t)(i > 0 ? samples[i - 1].value : 0)));
+  }
+  return w->error ? -1 : wire_len(w);
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_batch_encode(uint8_t *buf, uint16_t len, const struct sample *samples, uint8_t n)
+{
+  struct wire w;
+  uint8_t i;
+
+  wire_init(&w, buf, len);
+  if (SAMPLE_BATCH_COMPRESS && n > 0)
+  {
+    for (i = 1; i < n && samples[i].index == samples[0].index + i; i++);
+    if (i == n) return encode_delta(&w, samples, n);
+  }
+  return encode_plain(&w, samples, n);
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_batch_open(struct sample_batch_reader *r, const uint8_t *buf, uint16_t len)
+{
+  wire_init(&r->w, buf, len);
+  r->format = wire_get_u8(&r->w);
+  r->left = wire_get_varint(&r->w);
+  r->run = 0;
+  r->last.value = 0;
+  if (r->format == SAMPLE_BATCH_DELTA) r->last.index = wire_get_varint(&r->w) - 1;
+  else if (r->format != SAMPLE_BATCH_PLAIN) return -1;
+  return r->w.error ? -1 : r->left;
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_batch_next(struct sample_batch_reader *r, struct sample *s)
+{
+  if (r->left == 0) return 0;
+  r->left--;
+
+  if (r->format == SAMPLE_BATCH_PLAIN)
+  {
+    r->last.value = wire_get_svarint(&r->w);
+    r->last.index = wire_get_varint(&r->w);
+    r->last.interval = wire_get_varint(&r->w);
+  }
+  else
+  {
+    if (r->run == 0)
+    {
+      r->run = wire_get_varint(&r->w);
+      r->last.interval = wire_get_varint(&r->w);
+      if (r->run == 0) r->w.error = 1;
+    }
+    r->run--;
+    r->last.index++;
+    r->last.value = (int32_t)((uint32_t)r->last.value + (uint32_t)wire_get_svarint(&r->w));
+  }
+  if (r->w.error) return -1;
+  *s = r->last;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_ack_encode(uint8_t *buf, uint16_t len, uint16_t version, uint16_t interval)
+{
+  struct wire w;
+
+  wire_init(&w, buf, len);
+  wire_put_u8(&w, SAMPLE_CONFIG_ACK);
+  wire_put_u16(&w, version);
+  wire_put_u16(&w, interval);
+  return w.error ? -1 : wire_len(&w);
+}
+/*---------------------------------------------------------------------------*/
+int
+sample_ack_decode(const uint8_t *buf, uint16_t len, uint16_t *version, uint16_t *interval)
+{
+  struct wire w;
+
+  wire_init(&w, buf, len);
+  if (wire_get_u8(&w) != SAMPLE_CONFIG_ACK) return -1;
+  *version = wire_get_u16(&w);
+  *interval = wire_get_u16(&w);
+  return w.error ? -1 : 0;
+}
+/*---------------------------------------------------------------------------*/
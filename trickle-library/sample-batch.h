@@ -0,0 +1,72 @@
+/**
+ * \file
+ *         Sample batches sent from the nodes to the border router.
+ */
+
+#ifndef SAMPLE_BATCH_H_
+#define SAMPLE_BATCH_H_
+
+#include "contiki.h"
+
+#include "wire.h"
+
+/* First payload byte of every message on the sample port */
+#define SAMPLE_BATCH_PLAIN 0x01
+#define SAMPLE_BATCH_DELTA 0x02
+#define SAMPLE_CONFIG_ACK  0x03 /* Not a batch: see sample_ack_encode() */
+
+/*
+ * Delta batches carry the first index and count instead of every index,
+ * the interval once per run of equal intervals, and each value as a
+ * zigzag varint difference to the previous one. They are used whenever
+ * the indices are consecutive, unless disabled here; receivers decode
+ * both formats.
+ */
+#ifdef SAMPLE_BATCH_CONF_COMPRESS
+#define SAMPLE_BATCH_COMPRESS SAMPLE_BATCH_CONF_COMPRESS
+#else
+#define SAMPLE_BATCH_COMPRESS 1
+#endif
+
+/* Worst case encoded size of a batch of n samples */
+#define SAMPLE_BATCH_LEN(n) (9 + (n) * 15)
+
+struct sample
+{
+  int value;
+  int index;
+  int interval;
+};
+
+/* Returns the number of bytes written, or -1 if buf is too small */
+int sample_batch_encode(uint8_t *buf, uint16_t len, const struct sample *samples, uint8_t n);
+
+/* Streaming decoder, so receivers need no room for a whole batch */
+struct sample_batch_reader
+{
+  struct wire w;
+  uint8_t format;
+  uint16_t left; /* Samples not yet returned */
+  uint16_t run;  /* Samples left in the current interval run */
+  struct sample last;
+};
+
+/* Returns the number of samples in the batch, or -1 if it is malformed */
+int sample_batch_open(struct sample_batch_reader *r, const uint8_t *buf, uint16_t len);
+
+/* Returns 1 with the next sample in s, 0 at the end, or -1 on an error */
+int sample_batch_next(struct sample_batch_reader *r, struct sample *s);
+
+/*
+ * A node tells the root which config version it has applied, and the
+ * sampling period it uses as a result. Fixed size: type, version, interval.
+ */
+#define SAMPLE_ACK_LEN 5
+
+/* Returns the number of bytes written, or -1 if buf is too small */
+int sample_ack_encode(uint8_t *buf, uint16_t len, uint16_t version, uint16_t interval);
+
+/* Returns 0, or -1 if the message is not an ack */
+int sample_ack_decode(const uint8_t *buf, uint16_t len, uint16_t *version, uint16_t *interval);
+
+#endif /* SAMPLE_BATCH_H_ */
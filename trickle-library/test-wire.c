@@ -0,0 +1,283 @@
+/**
+ * \file
+ *         Round trips of the radio payload encoding (wire.c, sample-batch.c).
+ *
+ *         Build and run on the host with: make test TARGET=native
+ *         Every encoding is compared byte for byte with the expected
+ *         frame, decoded, and encoded again. The process exits with the
+ *         number of failed checks.
+ */
+
+#include "contiki.h"
+
+#include "sample-batch.h"
+#include "wire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(c) check((c), #c, __LINE__)
+
+static int failures, checks;
+
+PROCESS(test_wire_process, "Wire encoding test");
+AUTOSTART_PROCESSES(&test_wire_process);
+/*---------------------------------------------------------------------------*/
+static int
+check(int ok, const char *what, int line)
+{
+  checks++;
+  if (!ok)
+  {
+    failures++;
+    printf("FAIL line %d: %s\n", line, what);
+  }
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static int
+same_bytes(const uint8_t *a, int alen, const uint8_t *b, int blen)
+{
+  int i;
+
+  if (alen != blen) return 0;
+  for (i = 0; i < alen; i++) if (a[i] != b[i]) return 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_varint(uint32_t v, const uint8_t *bytes, uint8_t len)
+{
+  uint8_t buf[8] = { 0 };
+  struct wire w;
+
+  wire_init(&w, buf, sizeof(buf));
+  wire_put_varint(&w, v);
+  CHECK(!w.error && same_bytes(buf, wire_len(&w), bytes, len));
+  CHECK(wire_varint_len(v) == len);
+
+  wire_init(&w, bytes, len);
+  CHECK(wire_get_varint(&w) == v && !w.error && wire_left(&w) == 0);
+
+  /* Every shorter frame is cut off in the middle of the value */
+  wire_init(&w, bytes, len - 1);
+  wire_get_varint(&w);
+  CHECK(w.error);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_svarint(int32_t v, const uint8_t *bytes, uint8_t len)
+{
+  uint8_t buf[8] = { 0 };
+  struct wire w;
+
+  wire_init(&w, buf, sizeof(buf));
+  wire_put_svarint(&w, v);
+  CHECK(!w.error && same_bytes(buf, wire_len(&w), bytes, len));
+  CHECK(wire_svarint_len(v) == len);
+
+  wire_init(&w, bytes, len);
+  CHECK(wire_get_svarint(&w) == v && !w.error && wire_left(&w) == 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_wire(void)
+{
+  static const uint8_t u16[] = { 0x12, 0x34, 0xff, 0xff };
+  static const uint8_t overlong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+  uint8_t buf[4];
+  struct wire w;
+
+  test_varint(0, (const uint8_t *)"\x00", 1);
+  test_varint(1, (const uint8_t *)"\x01", 1);
+  test_varint(0x7f, (const uint8_t *)"\x7f", 1);
+  test_varint(0x80, (const uint8_t *)"\x80\x01", 2);
+  test_varint(0x3fff, (const uint8_t *)"\xff\x7f", 2);
+  test_varint(0x4000, (const uint8_t *)"\x80\x80\x01", 3);
+  test_varint(0xffff, (const uint8_t *)"\xff\xff\x03", 3);
+  test_varint(0xffffffffUL, (const uint8_t *)"\xff\xff\xff\xff\x0f", 5);
+
+  test_svarint(0, (const uint8_t *)"\x00", 1);
+  test_svarint(-1, (const uint8_t *)"\x01", 1);
+  test_svarint(1, (const uint8_t *)"\x02", 1);
+  test_svarint(-64, (const uint8_t *)"\x7f", 1);
+  test_svarint(64, (const uint8_t *)"\x80\x01", 2);
+  test_svarint(INT16_MIN, (const uint8_t *)"\xff\xff\x03", 3);
+  test_svarint(INT16_MAX, (const uint8_t *)"\xfe\xff\x03", 3);
+  test_svarint(INT32_MIN, (const uint8_t *)"\xff\xff\xff\xff\x0f", 5);
+  test_svarint(INT32_MAX, (const uint8_t *)"\xfe\xff\xff\xff\x0f", 5);
+
+  /* Fixed-size fields are in network byte order */
+  wire_init(&w, buf, sizeof(buf));
+  wire_put_u16(&w, 0x1234);
+  wire_put_u16(&w, 0xffff);
+  CHECK(!w.error && same_bytes(buf, wire_len(&w), u16, sizeof(u16)));
+  wire_init(&w, u16, sizeof(u16));
+  CHECK(wire_get_u16(&w) == 0x1234 && wire_get_u16(&w) == 0xffff && !w.error);
+
+  /* Writes and reads past the end are flagged, not performed */
+  wire_init(&w, buf, 1);
+  wire_put_u16(&w, 0x1234);
+  CHECK(w.error && wire_len(&w) == 1);
+  wire_init(&w, u16, 1);
+  wire_get_u16(&w);
+  CHECK(w.error);
+
+  wire_init(&w, overlong, sizeof(overlong));
+  wire_get_varint(&w);
+  CHECK(w.error);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_batch(const char *name, const struct sample *samples, uint8_t n, const uint8_t *bytes, uint8_t len)
+{
+  struct sample_batch_reader r;
+  struct sample s, decoded[8];
+  uint8_t buf[SAMPLE_BATCH_LEN(8)], again[SAMPLE_BATCH_LEN(8)];
+  int blen, i;
+
+  printf("Batch: %s\n", name);
+  blen = sample_batch_encode(buf, SAMPLE_BATCH_LEN(n), samples, n);
+  CHECK(blen <= SAMPLE_BATCH_LEN(n));
+  CHECK(same_bytes(buf, blen, bytes, len));
+  CHECK(sample_batch_encode(buf, len - 1, samples, n) == -1);
+
+  CHECK(sample_batch_open(&r, bytes, len) == n);
+  for (i = 0; i < n && sample_batch_next(&r, &s) == 1; i++)
+  {
+    CHECK(s.value == samples[i].value && s.index == samples[i].index && s.interval == samples[i].interval);
+    decoded[i] = s;
+  }
+  CHECK(i == n && sample_batch_next(&r, &s) == 0);
+
+  blen = sample_batch_encode(again, sizeof(again), decoded, n);
+  CHECK(same_bytes(again, blen, bytes, len));
+
+  /* A batch cut short fails instead of returning made up samples */
+  if (sample_batch_open(&r, bytes, len - 1) >= 0)
+  {
+    while ((i = sample_batch_next(&r, &s)) == 1);
+    CHECK(i == -1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_batches(void)
+{
+  static const struct sample plain[] = {
+    { 5, 3, 60 }, { -1, 7, 60 }, { INT16_MIN, 8, 300 }, { INT16_MAX, 12, 300 }
+  };
+  static const uint8_t plain_bytes[] = {
+    0x01, 0x04,
+    0x0a, 0x03, 0x3c,
+    0x01, 0x07, 0x3c,
+    0xff, 0xff, 0x03, 0x08, 0xac, 0x02,
+    0xfe, 0xff, 0x03, 0x0c, 0xac, 0x02
+  };
+  static const struct sample delta[] = {
+    { 1, 10, 60 }, { 2, 11, 60 }, { 2, 12, 120 }
+  };
+  static const uint8_t delta_bytes[] = {
+    0x02, 0x03, 0x0a,
+    0x02, 0x3c, 0x02, 0x02,
+    0x01, 0x78, 0x00
+  };
+  /* The first index is sent as is and the reader counts up from it */
+  static const struct sample first[] = {
+    { 0, 0, 1 }, { -1, 1, 1 }
+  };
+  static const uint8_t first_bytes[] = {
+    0x02, 0x02, 0x00,
+    0x02, 0x01, 0x00, 0x01
+  };
+  /* Value differences wrap around rather than grow */
+  static const struct sample swing[] = {
+    { INT16_MAX, 40, 150 }, { INT16_MIN, 41, 150 }, { INT16_MAX, 42, 150 }
+  };
+  static const uint8_t swing_bytes[] = {
+    0x02, 0x03, 0x28,
+    0x03, 0x96, 0x01,
+    0xfe, 0xff, 0x03,
+    0xfd, 0xff, 0x07,
+    0xfe, 0xff, 0x07
+  };
+  /* Past the largest 16-bit index, as a native node counts */
+  static const struct sample wide[] = {
+    { 7, INT16_MAX, 60 }, { 7, INT16_MAX + 1, 60 }
+  };
+  static const uint8_t wide_bytes[] = {
+    0x02, 0x02, 0xff, 0xff, 0x01,
+    0x02, 0x3c, 0x0e, 0x00
+  };
+  /* And as a 16-bit node counts: not consecutive here, so sent plain */
+  static const struct sample wrapped[] = {
+    { 7, INT16_MAX, 60 }, { 7, INT16_MIN, 60 }
+  };
+  static const uint8_t wrapped_bytes[] = {
+    0x01, 0x02,
+    0x0e, 0xff, 0xff, 0x01, 0x3c,
+    0x0e, 0x80, 0x80, 0xfe, 0xff, 0x0f, 0x3c
+  };
+
+  test_batch("plain", plain, 4, plain_bytes, sizeof(plain_bytes));
+  test_batch("delta", delta, 3, delta_bytes, sizeof(delta_bytes));
+  test_batch("delta from index 0", first, 2, first_bytes, sizeof(first_bytes));
+  test_batch("delta swinging values", swing, 3, swing_bytes, sizeof(swing_bytes));
+  test_batch("delta past INT16_MAX", wide, 2, wide_bytes, sizeof(wide_bytes));
+  test_batch("index wrapped to INT16_MIN", wrapped, 2, wrapped_bytes, sizeof(wrapped_bytes));
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_malformed(void)
+{
+  static const uint8_t unknown[] = { 0x7e, 0x00 };
+  static const uint8_t zero_run[] = { 0x02, 0x01, 0x00, 0x00, 0x3c, 0x00 };
+  static const uint8_t empty[] = { 0x01, 0x00 };
+  struct sample_batch_reader r;
+  struct sample s;
+
+  CHECK(sample_batch_open(&r, unknown, sizeof(unknown)) == -1);
+  CHECK(sample_batch_open(&r, unknown, 0) == -1);
+  CHECK(sample_batch_open(&r, zero_run, sizeof(zero_run)) == 1);
+  CHECK(sample_batch_next(&r, &s) == -1);
+  CHECK(sample_batch_open(&r, empty, sizeof(empty)) == 0);
+  CHECK(sample_batch_next(&r, &s) == 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_ack(void)
+{
+  static const uint8_t ack[] = { 0x03, 0xff, 0xf0, 0x00, 0x3c };
+  static const uint8_t batch[] = { 0x01, 0x00, 0x00, 0x00, 0x00 };
+  uint8_t buf[SAMPLE_ACK_LEN];
+  uint16_t version, interval;
+
+  CHECK(sample_ack_encode(buf, sizeof(buf), 0xfff0, 60) == SAMPLE_ACK_LEN);
+  CHECK(same_bytes(buf, SAMPLE_ACK_LEN, ack, sizeof(ack)));
+  CHECK(sample_ack_encode(buf, sizeof(buf) - 1, 0xfff0, 60) == -1);
+
+  CHECK(sample_ack_decode(ack, sizeof(ack), &version, &interval) == 0);
+  CHECK(version == 0xfff0 && interval == 60);
+  CHECK(sample_ack_encode(buf, sizeof(buf), version, interval) == SAMPLE_ACK_LEN);
+  CHECK(same_bytes(buf, SAMPLE_ACK_LEN, ack, sizeof(ack)));
+
+  CHECK(sample_ack_decode(ack, sizeof(ack) - 1, &version, &interval) == -1);
+  CHECK(sample_ack_decode(batch, sizeof(batch), &version, &interval) == -1);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_wire_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  test_wire();
+  test_batches();
+  test_malformed();
+  test_ack();
+
+  printf("%d of %d checks failed\n", failures, checks);
+  exit(failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
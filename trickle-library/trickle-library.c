@@ -2,15 +2,18 @@
 #include "contiki-lib.h"
 #include "contiki-net.h"
 #include "lib/random.h"
-#include "lib/trickle-timer.h"
 #include "net/ip/uip.h"
 #include "net/ip/uip-debug.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"
 #include "sys/ctimer.h"
 #include "sys/etimer.h"
 #include "sys/node-id.h"
 
+#include "config-dissem.h"
 #include "node-id.h"
+#include "sample-batch.h"
 #include "servreg-hack.h"
 #include "simple-udp.h"
 
@@ -19,105 +22,205 @@
 
 #define UDP_PORT 1234
 #define SERVICE_ID 190
-#define IMIN 16 /* ticks */
-#define IMAX 10 /* doublings */
-#define REDUNDANCY_CONST 2
-#define NSAMPLES 3
-#define NSAMPLEPERIOD1 300
-#define NSAMPLEPERIOD2 600
-#define TRICKLE_PROTO_PORT 30001
-
-static struct collect_conn tc;
+
+/* Sampling period until the border router disseminates another one */
+#ifdef SAMPLE_CONF_PERIOD
+#define SAMPLE_PERIOD SAMPLE_CONF_PERIOD
+#else
+#define SAMPLE_PERIOD 150 /* seconds */
+#endif
+
+/* A 16-bit clock cannot time long waits in one go, they are done in steps */
+#define TIMER_STEP 256 /* seconds */
+
+/*
+ * Samples are batched until the encoded frame is full or the oldest one
+ * reaches BATCH_MAX_AGE seconds. The default payload is what is left of a
+ * 127 byte 802.15.4 frame after the MAC and compressed IPv6/UDP headers,
+ * so a batch never needs 6LoWPAN fragmentation.
+ */
+#ifdef BATCH_CONF_LINK_PAYLOAD
+#define BATCH_LINK_PAYLOAD BATCH_CONF_LINK_PAYLOAD
+#else
+#define BATCH_LINK_PAYLOAD 64
+#endif
+#define BATCH_IP_PAYLOAD (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN)
+#define BATCH_PAYLOAD (BATCH_LINK_PAYLOAD < BATCH_IP_PAYLOAD ? BATCH_LINK_PAYLOAD : BATCH_IP_PAYLOAD)
+
+#ifdef BATCH_CONF_MAX_SAMPLES
+#define BATCH_MAX_SAMPLES BATCH_CONF_MAX_SAMPLES
+#else
+#define BATCH_MAX_SAMPLES 32
+#endif
+
+#ifdef BATCH_CONF_MAX_AGE
+#define BATCH_MAX_AGE BATCH_CONF_MAX_AGE
+#else
+#define BATCH_MAX_AGE 900 /* seconds */
+#endif
+
+/*
+ * Sinks are the border routers registered for SERVICE_ID, looked up again
+ * every SINK_TTL seconds. Batches go to the root of our DODAG when it is a
+ * sink, as it is the closest, and otherwise stay with one sink for as long
+ * as it is registered. With SINK_CONF_BALANCE they go round all sinks.
+ */
+#ifdef SINK_CONF_MAX
+#define SINK_MAX SINK_CONF_MAX
+#else
+#define SINK_MAX 4
+#endif
+
+#ifdef SINK_CONF_TTL
+#define SINK_TTL SINK_CONF_TTL
+#else
+#define SINK_TTL 60 /* seconds */
+#endif
+
+#ifdef SINK_CONF_BALANCE
+#define SINK_BALANCE SINK_CONF_BALANCE
+#else
+#define SINK_BALANCE 0
+#endif
+
+/* Frames kept while no sink is known, tried again every BATCH_RETRY_PERIOD
+ * seconds. When they are all taken the oldest is dropped. */
+#ifdef BATCH_CONF_RETRY_FRAMES
+#define BATCH_RETRY_FRAMES BATCH_CONF_RETRY_FRAMES
+#else
+#define BATCH_RETRY_FRAMES 2
+#endif
+#define BATCH_RETRY_PERIOD 10
+
+/*
+ * Nodes ack each config version they apply to the root. The nodes an
+ * update reaches together spread their acks over ACK_JITTER, and the ack
+ * goes again with the next batch in case the first one was lost.
+ */
+#define ACK_JITTER (2 * CLOCK_SECOND)
+
 static struct simple_udp_connection unicast_connection;
-static struct uip_udp_conn *trickle_conn;
 
-struct sample
-{
-  int value;
-  int index;
-  int interval;
-};
+static uint16_t sample_interval = SAMPLE_PERIOD;
+static unsigned long sample_left; /* Seconds until the next sample */
+static uint16_t sample_step;      /* Seconds the sample timer is set for */
 
-struct trickle_packet
-{
-  uint8_t token;
-  int node;
-  int interval;
-};
+static struct sample batch[BATCH_MAX_SAMPLES];
+static uint8_t batch_len;
+static int batch_bytes; /* Encoded size of the current batch */
+static unsigned long batch_start;
+static uint8_t frame[BATCH_PAYLOAD];
+static unsigned long frames_sent, samples_sent, frames_dropped;
 
-static struct etimer et;
-static struct trickle_timer tt;
-static struct trickle_packet packet;
-static int sample_interval = NSAMPLEPERIOD1;
-static uip_ipaddr_t ipaddr;
-static int interval_changed = 0;
+static uint8_t retry[BATCH_RETRY_FRAMES][BATCH_PAYLOAD];
+static uint8_t retry_len[BATCH_RETRY_FRAMES];
+static uint8_t retry_samples[BATCH_RETRY_FRAMES];
+static uint8_t retry_first, retry_count;
+static struct etimer retry_timer;
+
+static uip_ipaddr_t sinks[SINK_MAX];
+static uint8_t sink_count;
+static uip_ipaddr_t sink_used; /* Batches stay with it while it is a sink */
+static unsigned long sinks_at;
+
+static struct ctimer ack_timer;
+static uint16_t ack_version; /* The config version last acked */
+static uint8_t ack_again;    /* Send the ack again with the next batch */
 
 /*---------------------------------------------------------------------------*/
 PROCESS(unicast_sender_process, "Unicast Sender Process");
 PROCESS(trickle_protocol_process, "Trickle Protocol Process");
 AUTOSTART_PROCESSES(&trickle_protocol_process, &unicast_sender_process);
 /*---------------------------------------------------------------------------*/
+static uint16_t
+dag_rank(void)
+{
+  rpl_dag_t *dag = rpl_get_any_dag();
+
+  if (dag == NULL || dag->instance == NULL) return 0xffff;
+  return DAG_RANK(dag->rank, dag->instance);
+}
+/*---------------------------------------------------------------------------*/
 static void
-tcpip_handler(void)
+config_refresh(void)
 {
-  if (uip_newdata())
+  struct config_entry *cur = config_table_match(node_id, dag_rank());
+  uint16_t interval = cur != NULL && cur->interval > 0 ? cur->interval : SAMPLE_PERIOD;
+
+  if (interval == sample_interval) return;
+
+  sample_interval = interval;
+  PRINTF("Change Node [%d]'s Interval => %u\n", node_id, sample_interval);
+
+  /* Let the sender reschedule now instead of after the old period */
+  process_poll(&unicast_sender_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+config_applied(const struct config_entry *e)
+{
+  if (config_selector_match(&e->sel, node_id, dag_rank())) config_refresh();
+}
+/*---------------------------------------------------------------------------*/
+static void
+sink_refresh(void)
+{
+  servreg_hack_item_t *item;
+
+  sink_count = 0;
+  for (item = servreg_hack_list_head(); item != NULL && sink_count < SINK_MAX; item = list_item_next(item))
   {
-    struct trickle_packet data = ((struct trickle_packet *)uip_appdata)[0];
-    PRINTF("At %lu (I=%lu, c=%u): ", (unsigned long)clock_time(), (unsigned long)tt.i_cur, tt.c);
-    PRINTF("Our token=0x%02x, theirs=0x%02x\n", packet.token, data.token);
-    if (packet.token == data.token)
-    {
-      PRINTF("Consistent RX\n");
-      trickle_timer_consistency(&tt);
-    }
-    else
-    {
-      if ((signed char)(packet.token - data.token) < 0)
-      {
-        PRINTF("Theirs is newer. Update\n");
-        packet.token = data.token;
-
-        if (data.node == node_id)
-        {
-          if (sample_interval == NSAMPLEPERIOD1)
-            interval_changed = 1;
-          else if (sample_interval == 2)
-            interval_changed = 2;
-          if (data.interval == NSAMPLEPERIOD2)
-            sample_interval = NSAMPLEPERIOD1;
-          else if (data.interval == 2)
-            sample_interval = NSAMPLEPERIOD2;
-          PRINTF("Change Node [%d]'s Interval => %d\n", node_id, sample_interval);
-        }
-      }
-      else  PRINTF("They are behind\n");
-
-      trickle_timer_inconsistency(&tt);
-      PRINTF("At %lu: Trickle inconsistency. Scheduled TX for %lu\n", (unsigned long)clock_time(), (unsigned long)(tt.ct.etimer.timer.start + tt.ct.etimer.timer.interval));
-    }
+    if (servreg_hack_item_id(item) == SERVICE_ID) uip_ipaddr_copy(&sinks[sink_count++], servreg_hack_item_address(item));
   }
-  return;
+  sinks_at = clock_seconds();
 }
 /*---------------------------------------------------------------------------*/
-static void trickle_tx(void *ptr, uint8_t suppress)
+/* rotate moves on to the next sink when balancing */
+static uip_ipaddr_t *
+sink_select(uint8_t rotate)
 {
-  /* *ptr is a pointer to the trickle_timer that triggered this callback. In
-   * his example we know that ptr points to tt. However, we pretend that we did
-   * not know (which would be the case if we e.g. had multiple trickle timers)
-   * and cast it to a local struct trickle_timer* */
-  struct trickle_timer *loc_tt = (struct trickle_timer *)ptr;
+  rpl_dag_t *dag = rpl_get_any_dag();
+  uint8_t i, cur = 0;
 
-  if (suppress == TRICKLE_TIMER_TX_SUPPRESS) return;
+  if (sink_count == 0 || clock_seconds() - sinks_at >= SINK_TTL) sink_refresh();
+  if (sink_count == 0) return NULL;
 
-  PRINTF("At %lu (I=%lu, c=%u): ", (unsigned long)clock_time(), (unsigned long)loc_tt->i_cur, loc_tt->c);
-  PRINTF("Trickle TX token 0x%02x\n", packet.token);
+  for (i = 0; i < sink_count; i++)
+  {
+    if (uip_ipaddr_cmp(&sinks[i], &sink_used)) cur = i;
+  }
+  if (SINK_BALANCE && rotate) cur = (cur + 1) % sink_count;
+  else if (!SINK_BALANCE && dag != NULL)
+  {
+    for (i = 0; i < sink_count; i++)
+    {
+      if (uip_ipaddr_cmp(&sinks[i], &dag->dag_id)) cur = i;
+    }
+  }
+
+  if (!uip_ipaddr_cmp(&sinks[cur], &sink_used))
+  {
+    PRINTF("Sink now ");
+    PRINT6ADDR(&sinks[cur]);
+    PRINTF("\n");
+    uip_ipaddr_copy(&sink_used, &sinks[cur]);
+  }
+  return &sinks[cur];
+}
+/*---------------------------------------------------------------------------*/
+static void
+ack_send(void *ptr)
+{
+  uint8_t buf[SAMPLE_ACK_LEN];
+  uip_ipaddr_t *addr;
+  int len;
 
-  /* Destination IP: link-local all-nodes multicast */
-  uip_ipaddr_copy(&trickle_conn->ripaddr, &ipaddr);
-  uip_udp_packet_send(trickle_conn, &packet, sizeof(packet));
+  addr = sink_select(0);
+  len = sample_ack_encode(buf, sizeof(buf), ack_version, sample_interval);
+  if (addr == NULL || len < 0) return;
 
-  /* Restore to 'accept incoming from any IP' */
-  uip_create_unspecified(&trickle_conn->ripaddr);
+  PRINTF("Ack config version 0x%04x, interval %u\n", ack_version, sample_interval);
+  simple_udp_sendto(&unicast_connection, buf, len, addr);
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(trickle_protocol_process, ev, data)
@@ -126,28 +229,27 @@ PROCESS_THREAD(trickle_protocol_process, ev, data)
 
   PRINTF("Trickle protocol started\n");
 
-  uip_create_linklocal_allnodes_mcast(&ipaddr);
+  config_dissem_init(config_applied);
 
-  trickle_conn = udp_new(NULL, UIP_HTONS(TRICKLE_PROTO_PORT), NULL);
-  udp_bind(trickle_conn, UIP_HTONS(TRICKLE_PROTO_PORT));
-
-  PRINTF("Connection: local/remote port %u/%u\n", UIP_HTONS(trickle_conn->lport), UIP_HTONS(trickle_conn->rport));
-
-  packet.token = 0;
-
-  trickle_timer_config(&tt, IMIN, IMAX, REDUNDANCY_CONST);
-  trickle_timer_set(&tt, trickle_tx, &tt);
   while (1)
   {
     PROCESS_YIELD();
-    if (ev == tcpip_event) tcpip_handler();
+    if (ev != tcpip_event) continue;
+
+    config_dissem_input();
+    if (config_dissem_applied() != ack_version)
+    {
+      ack_version = config_dissem_applied();
+      ack_again = 1;
+      ctimer_set(&ack_timer, random_rand() % ACK_JITTER, ack_send, NULL);
+    }
   }
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
-static void receiver(struct simple_udp_connection *c, const uip_ipaddr_t *sender_addr, uint16_t sender_port, const uip_ipaddr_t *receiver_addr, uint16_t receiver_port, const struct sample *data, uint16_t datalen)
+static void receiver(struct simple_udp_connection *c, const uip_ipaddr_t *sender_addr, uint16_t sender_port, const uip_ipaddr_t *receiver_addr, uint16_t receiver_port, const uint8_t *data, uint16_t datalen)
 {
   printf("Data received on port %d from port %d with length %d\n", receiver_port, sender_port, datalen);
 }
@@ -175,12 +277,121 @@ static void set_global_address(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Returns 0 if there is no sink to send it to */
+static int
+frame_send(const uint8_t *buf, uint8_t len, uint8_t n)
+{
+  uip_ipaddr_t *addr = sink_select(1);
+
+  if (addr == NULL) return 0;
+
+  frames_sent++;
+  samples_sent += n;
+  printf("Sending %u samples (%d bytes) to ", n, len);
+  uip_debug_ipaddr_print(addr);
+  printf(", %lu.%02lu samples/frame\n", samples_sent / frames_sent, (100 * (samples_sent % frames_sent)) / frames_sent);
+  simple_udp_sendto(&unicast_connection, buf, len, addr);
+
+  if (ack_again)
+  {
+    ack_again = 0;
+    ack_send(NULL);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the frames kept while no sink was known, oldest first */
+static void
+retry_flush(void)
+{
+  while (retry_count > 0 && frame_send(retry[retry_first], retry_len[retry_first], retry_samples[retry_first]))
+  {
+    retry_first = (retry_first + 1) % BATCH_RETRY_FRAMES;
+    retry_count--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+retry_add(const uint8_t *buf, uint8_t len, uint8_t n)
+{
+  uint8_t i;
+
+  if (retry_count == BATCH_RETRY_FRAMES)
+  {
+    frames_dropped++;
+    retry_first = (retry_first + 1) % BATCH_RETRY_FRAMES;
+    retry_count--;
+  }
+  i = (retry_first + retry_count) % BATCH_RETRY_FRAMES;
+  memcpy(retry[i], buf, len);
+  retry_len[i] = len;
+  retry_samples[i] = n;
+  retry_count++;
+  printf("Service %d not found, %u frames waiting, %lu dropped\n", SERVICE_ID, retry_count, frames_dropped);
+
+  if (etimer_expired(&retry_timer)) etimer_set(&retry_timer, CLOCK_SECOND * BATCH_RETRY_PERIOD);
+}
+/*---------------------------------------------------------------------------*/
+static void
+batch_send(uint8_t n)
+{
+  int len;
+
+  len = sample_batch_encode(frame, sizeof(frame), batch, n);
+  if (len < 0) printf("Batch of %u samples does not fit\n", n);
+  else
+  {
+    /* Frames that waited go first, so that samples arrive in order */
+    retry_flush();
+    if (retry_count > 0 || !frame_send(frame, len, n)) retry_add(frame, len, n);
+  }
+
+  /* Whatever did not fit starts the next batch */
+  batch_len -= n;
+  memmove(&batch[0], &batch[n], batch_len * sizeof(struct sample));
+  batch_start = clock_seconds();
+}
+/*---------------------------------------------------------------------------*/
+static void
+batch_add(const struct sample *s)
+{
+  int len;
+
+  if (batch_len == 0) batch_start = clock_seconds();
+  batch[batch_len++] = *s;
+
+  len = sample_batch_encode(frame, sizeof(frame), batch, batch_len);
+  if (len < 0)
+  {
+    /* The new sample overflowed the frame, send the ones before it */
+    batch_send(batch_len - 1);
+    len = sample_batch_encode(frame, sizeof(frame), batch, batch_len);
+  }
+  else if (batch_len == BATCH_MAX_SAMPLES || len + (len - batch_bytes) > (int)sizeof(frame))
+  {
+    /* Full, or the next sample is unlikely to fit in what is left */
+    batch_send(batch_len);
+    len = 0;
+  }
+  batch_bytes = len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sample_schedule(struct etimer *et, unsigned long left)
+{
+  sample_left = left;
+  sample_step = left < TIMER_STEP ? left : TIMER_STEP;
+  etimer_set(et, CLOCK_SECOND * sample_step);
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(unicast_sender_process, ev, data)
 {
   static struct etimer periodic;
+  static struct etimer deadline;
   static int index_samples = 0;
-  static struct sample samples[NSAMPLES];
-  uip_ipaddr_t *addr;
+  static unsigned long last_sample;
+  struct sample sample;
+  unsigned long age;
 
   PROCESS_BEGIN();
 
@@ -190,40 +401,58 @@ PROCESS_THREAD(unicast_sender_process, ev, data)
 
   simple_udp_register(&unicast_connection, UDP_PORT, NULL, UDP_PORT, receiver);
 
+  last_sample = clock_seconds();
+  sample_schedule(&periodic, sample_interval);
   while (1)
   {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER || ev == PROCESS_EVENT_POLL);
 
-    etimer_set(&periodic, CLOCK_SECOND * sample_interval / 2);
-
-    PROCESS_WAIT_UNTIL(etimer_expired(&periodic));
-
+    if (ev == PROCESS_EVENT_POLL)
+    {
+      /* The period changed, count the new one from the last sample */
+      age = clock_seconds() - last_sample;
+      sample_schedule(&periodic, age < sample_interval ? sample_interval - age : 0);
+    }
+    else if (data == &retry_timer)
+    {
+      retry_flush();
+      if (retry_count > 0) etimer_restart(&retry_timer);
+    }
+    else if (data == &periodic && sample_left > sample_step)
     {
-      samples[index_samples % NSAMPLES].value = random_rand() % 50;
-      samples[index_samples % NSAMPLES].index = index_samples + 1;
-      if (interval_changed != 0)
-      {
-        samples[index_samples % NSAMPLES].interval = interval_changed;
-        interval_changed = 0;
-      }
-      else if (sample_interval == NSAMPLEPERIOD1)
-        samples[index_samples % NSAMPLES].interval = 1;
-      else if (sample_interval == NSAMPLEPERIOD2)
-        samples[index_samples % NSAMPLES].interval = 2;
-      printf("[New Sample]: Value = %d | Index = %d | Interval Used = %d\n", samples[index_samples % NSAMPLES].value, samples[index_samples % NSAMPLES].index, samples[index_samples % NSAMPLES].interval);
+      sample_schedule(&periodic, sample_left - sample_step);
+    }
+    else if (data == &periodic)
+    {
+      /* Rank selectors follow the node as it moves in the DODAG */
+      config_refresh();
+
+      sample.value = random_rand() % 50;
+      sample.index = index_samples + 1;
+      sample.interval = sample_interval;
+      printf("[New Sample]: Value = %d | Index = %d | Interval Used = %d\n", sample.value, sample.index, sample.interval);
 
       index_samples++;
+      batch_add(&sample);
+      last_sample = clock_seconds();
+      sample_schedule(&periodic, sample_interval);
+    }
 
-      if (index_samples % NSAMPLES != 0) continue;
-
-      addr = servreg_hack_lookup(SERVICE_ID);
-      if (addr != NULL)
-      {
-        printf("Sending unicast to ");
-        uip_debug_ipaddr_print(addr);
-        printf("\n");
-        simple_udp_sendto(&unicast_connection, samples, sizeof(samples), addr);
-      }
-      else printf("Service %d not found\n", SERVICE_ID);
+    if (batch_len == 0)
+    {
+      etimer_stop(&deadline);
+      continue;
+    }
+    age = clock_seconds() - batch_start;
+    if (age >= BATCH_MAX_AGE)
+    {
+      batch_send(batch_len);
+      etimer_stop(&deadline);
+    }
+    else
+    {
+      age = BATCH_MAX_AGE - age;
+      etimer_set(&deadline, CLOCK_SECOND * (age < TIMER_STEP ? age : TIMER_STEP));
     }
   }
   PROCESS_END();
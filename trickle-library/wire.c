@@ -0,0 +1,113 @@
+#include "contiki.h"
+
+#include "wire.h"
+
+#define ZIGZAG(v)   (((uint32_t)(v) << 1) ^ (uint32_t)((v) < 0 ? -1 : 0))
+#define UNZIGZAG(v) ((int32_t)((v) >> 1) ^ -(int32_t)((v) & 1))
+
+/*---------------------------------------------------------------------------*/
+void
+wire_init(struct wire *w, const void *buf, uint16_t len)
+{
+  w->start = w->ptr = (uint8_t *)buf;
+  w->end = w->start + len;
+  w->error = 0;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+wire_len(const struct wire *w)
+{
+  return w->ptr - w->start;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+wire_left(const struct wire *w)
+{
+  return w->end - w->ptr;
+}
+/*---------------------------------------------------------------------------*/
+void
+wire_put_u8(struct wire *w, uint8_t v)
+{
+  if (w->ptr < w->end) *w->ptr++ = v;
+  else w->error = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+wire_put_u16(struct wire *w, uint16_t v)
+{
+  wire_put_u8(w, v >> 8);
+  wire_put_u8(w, v & 0xff);
+}
+/*---------------------------------------------------------------------------*/
+void
+wire_put_varint(struct wire *w, uint32_t v)
+{
+  while (v >= 0x80)
+  {
+    wire_put_u8(w, (v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  wire_put_u8(w, v);
+}
+/*---------------------------------------------------------------------------*/
+void
+wire_put_svarint(struct wire *w, int32_t v)
+{
+  wire_put_varint(w, ZIGZAG(v));
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+wire_get_u8(struct wire *w)
+{
+  if (w->ptr < w->end) return *w->ptr++;
+  w->error = 1;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+wire_get_u16(struct wire *w)
+{
+  uint16_t v = (uint16_t)wire_get_u8(w) << 8;
+  return v | wire_get_u8(w);
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+wire_get_varint(struct wire *w)
+{
+  uint32_t v = 0;
+  uint8_t shift, b;
+
+  for (shift = 0; shift < 32; shift += 7)
+  {
+    b = wire_get_u8(w);
+    v |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) return v;
+  }
+  /* More than five bytes: not something we ever write */
+  w->error = 1;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int32_t
+wire_get_svarint(struct wire *w)
+{
+  uint32_t v = wire_get_varint(w);
+  return UNZIGZAG(v);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+wire_varint_len(uint32_t v)
+{
+  uint8_t len;
+
+  for (len = 1; v >= 0x80; len++) v >>= 7;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+wire_svarint_len(int32_t v)
+{
+  return wire_varint_len(ZIGZAG(v));
+}
+/*---------------------------------------------------------------------------*/
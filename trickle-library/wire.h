@@ -0,0 +1,43 @@
+/**
+ * \file
+ *         Endian-neutral encoding of the radio payloads.
+ *
+ *         Fields are written byte by byte: fixed-size fields in network
+ *         byte order, integers as LEB128 varints (zigzag for signed
+ *         values). Nothing depends on the platform's int width, padding or
+ *         byte order, so a Z1 and a native border router agree on the
+ *         layout.
+ */
+
+#ifndef WIRE_H_
+#define WIRE_H_
+
+#include "contiki.h"
+
+struct wire
+{
+  uint8_t *start;
+  uint8_t *ptr;
+  uint8_t *end;
+  uint8_t error; /* Set when a read or write ran past the end */
+};
+
+void wire_init(struct wire *w, const void *buf, uint16_t len);
+uint16_t wire_len(const struct wire *w);
+uint16_t wire_left(const struct wire *w);
+
+void wire_put_u8(struct wire *w, uint8_t v);
+void wire_put_u16(struct wire *w, uint16_t v);
+void wire_put_varint(struct wire *w, uint32_t v);
+void wire_put_svarint(struct wire *w, int32_t v);
+
+uint8_t wire_get_u8(struct wire *w);
+uint16_t wire_get_u16(struct wire *w);
+uint32_t wire_get_varint(struct wire *w);
+int32_t wire_get_svarint(struct wire *w);
+
+/* Encoded size of a value, without writing it */
+uint8_t wire_varint_len(uint32_t v);
+uint8_t wire_svarint_len(int32_t v);
+
+#endif /* WIRE_H_ */